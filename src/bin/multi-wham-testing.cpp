@@ -2,9 +2,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <cmath>
 #include <time.h>
 #include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <string.h>
 #include "split.h"
 #include "KMERUTILS.h"
 
@@ -14,18 +20,28 @@
 // bamtools and my headers
 #include "api/BamMultiReader.h"
 #include "readPileUp.h"
-
-// msa headers
-#include <seqan/align.h>
-#include <seqan/graph_msa.h>
+#include "bamPool.h"
+#include "baiIndex.h"
+#include "regionScheduler.h"
+#include "vcfWriter.h"
+#include "kmerMask.h"
+#include "clipConsensus.h"
+#include "microAssembler.h"
+#include "clipFrontier.h"
+#include "glKernel.h"
+#include "siteRandom.h"
+#include "depthSampler.h"
+#include "insertStatsCache.h"
+#include "libraryStats.h"
+#include "readGroupIndex.h"
+#include "evidenceFile.h"
 
 using namespace std;
 using namespace BamTools;
 
-struct cigar{
-  char type;
-  unsigned int length;
-};
+#define GENOTYPE_MAX_READS 1000   // reads per sample kept for genotyping
+#define CANDIDATE_PAD      1000   // bp read ahead of each --two-phase site
+#define DISCOVERY_MIN_CLIPS   1   // clipped ends a sample needs in discovery
 
 struct regionDat{
   int seqidIndex ;
@@ -33,6 +49,18 @@ struct regionDat{
   int end        ;
 };
 
+// clipped positions near enough to be one breakpoint; they are scored
+// once, at the position most reads are clipped at
+
+struct clipGroup{
+  long int first   ;
+  long int last    ;
+  long int mode    ;
+  int      nClipped;  // clipped read ends buffered for the group
+  char     side    ;  // 'f' or 'b' for the clips on one side, 0 for both
+  bool     evidence;  // discovery: split or discordant reads at the mode
+};
+
 struct indvDat{
   bool   support       ;
   string genotype      ;
@@ -55,30 +83,51 @@ struct indvDat{
   vector<double> inserts;
   vector<double> hInserts;
   vector<long double> gls;
-  vector< BamAlignment > alignments;
-  vector<int> badFlag;
+  vector< string > alignments;
+  vector<int> badFlag;  // up to GENOTYPE_MAX_READS of the nReads, sampled
   vector<int> MapQ;
   map<int, vector<string> > cluster;
 };
 
+// indexed by sample, and the cutoffs by read group
+
 struct insertDat{
-  map<string, double> mus; // mean of insert length for each indvdual across 1e6 reads
-  map<string, double> sds;  // standard deviation
-  map<string, double> lq ;  // 25% of data
-  map<string, double> up ;  // 75% of the data
-  map<string, double> avgD; 
+  vector<double> mus; // mean of insert length for each indvdual across 1e6 reads
+  vector<double> sds;  // standard deviation
+  vector<double> avgD; 
+  vector<double> lowCut;   // inserts below or above are odd
+  vector<double> highCut;
   double overallDepth;
 } insertDists;
 
+// the read groups of every sample, interned from the headers at start
+// up and only read after
+
+readGroupIndex readGroups;
+
+// each sample's statistics, as sampled or reused; --two-phase writes
+// them into the evidence files it gathers
+
+vector<insertStats> sampleStats;
+
 struct global_opts {
   vector<string> targetBams    ;
   vector<string> backgroundBams;
   vector<string> all           ;
+  vector<string> samples       ;  // each distinct BAM in all, once
+  vector<int>    sampleIds     ;  // the sample of each file in all
+  vector<string> readFrom      ;  // what the pools open for each file in all
   int            nthreads      ;
   string         seqid         ;
   string         bed           ; 
   string         mask          ;
   vector<int>    region        ; 
+  bool           assemble      ;
+  int            clipWindow    ;
+  unsigned long  seed          ;
+  int            maxDepth      ;  // 0 loads every read
+  bool           statsCache    ;  // reuse and write <bam>.wham.stats
+  bool           twoPhase      ;  // discover per sample, then genotype
 } globalOpts;
 
 
@@ -107,12 +156,65 @@ inline bool aminan(T value)
 
 }
 
-static const char *optString ="ht:b:r:x:e:m:";
+static const char *optString ="aht:b:r:x:e:m:w:s:d:";
+
+static const struct option longOpts[] = {
+  {"seed",      required_argument, NULL, 's'},
+  {"max-depth", required_argument, NULL, 'd'},
+  {"no-stats-cache", no_argument,  NULL, 'S'},
+  {"two-phase", no_argument,       NULL, 'P'},
+  {NULL,        0,                 NULL,  0 }
+};
 
 // this lock prevents threads from printing on top of each other
 
 omp_lock_t lock;
 
+// one long-lived reader pool per OpenMP thread
+
+vector<bamPool *> readerPools;
+
+// --two-phase discovery and gathering read one sample at a time; one
+// single-file pool per thread, reopened when its thread moves to
+// another sample
+
+vector<bamPool *> samplePools;
+
+// one breakpoint assembler per thread, when -a is given
+
+vector<microAssembler *> assemblers;
+
+// the stages score() stops a position at, cheapest first; the last
+// counts the positions that were called
+
+enum scoreStage { STAGE_CLUSTER, STAGE_EVIDENCE, STAGE_MAPQ, STAGE_CLIPS,
+		  STAGE_ENDS, STAGE_CONSENSUS, STAGE_GENOTYPE, STAGE_CALLED,
+		  N_SCORE_STAGES };
+
+static const char * scoreStageNames[N_SCORE_STAGES] = {
+  "cluster size", "SV evidence", "mapping quality", "unique clips",
+  "breakpoint end", "clip consensus", "genotypes", "called" };
+
+// positions per stage, one row per thread so counting needs no lock
+
+vector< vector<long int> > stageCounts;
+
+// per-sample genotype state, one row per thread, reset for each
+// candidate rather than allocated
+
+vector< vector<indvDat> > genotypeScratch;
+vector<glKernel>          glKernels;
+vector<siteRandom>        siteRandoms;
+
+// reads --max-depth kept out of the pileup, one count per thread
+
+vector<long int> readsDownsampled;
+
+// hands out regions in the genome-wide run; NULL for a single region
+
+regionScheduler * scheduler = NULL;
+vcfWriter       * writer    = NULL;
+
 bool sortStringSize(string i, string j) {return (i.size() < j.size());}
 
 //ripped from EKG @ github Shannon Entropy
@@ -175,20 +277,7 @@ void initIndv(indvDat * s){
   s->hInserts.clear();
   s->badFlag.clear();
   s->MapQ.clear();
-}
-
-string collapseCigar(vector<CigarOp> & v){
-  
-  stringstream ss;
-
-  for(vector<CigarOp>::iterator it = v.begin(); it != v.end(); it++){
-    ss << (*it).Length;
-    ss << (*it).Type;
-    
-  }
-  
-  return ss.str();
-
+  s->gls.clear();
 }
 
 void printHeader(void){
@@ -210,6 +299,12 @@ void printHeader(void){
   cout << "##INFO=<ID=MQF,Number=1,Type=String,Description=\"Fraction of reads with MQ less than 50\">"   << endl;
   cout << "##INFO=<ID=END,Number=1,Type=Integer,Description=\"End position of the variant described in this record\">"      << endl;
   cout << "##INFO=<ID=SVLEN,Number=1,Type=Integer,Description=\"Difference in length between POS and end\">"         << endl;
+  if(globalOpts.assemble){
+    cout << "##INFO=<ID=CTG,Number=1,Type=String,Description=\"Contig assembled from the reads clipped or split at POS or none:.\">" << endl;
+  }
+  if(globalOpts.maxDepth > 0){
+    cout << "##INFO=<ID=DS,Number=0,Type=Flag,Description=\"Reads at POS were downsampled to a depth of " << globalOpts.maxDepth << "\">" << endl;
+  }
   cout << "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">"                                                  << endl;
   cout << "##FORMAT=<ID=GL,Number=A,Type=Float,Description=\"Genotype likelihood\">"                                        << endl;
   cout << "##FORMAT=<ID=NR,Number=1,Type=Integer,Description=\"Number of reads that do not support a SV\">"                 << endl;
@@ -247,7 +342,7 @@ string printIndvDat(  indvDat * d ){
 
   ss << "Genotype       : .......... " << d->genotype          << endl;
   ss << "Genotype index : .......... " << d->genotypeIndex     << endl;
-  ss << "Number of reads: .......... " << d->badFlag.size()    << endl;
+  ss << "Number of reads: .......... " << d->nReads            << endl;
   ss << "Number of mapped mates: ... " << d->mappedPairs       << endl;
   ss << "Number of odd insert size:  " << d->nAboveAvg         << endl;
   ss << "Number of reads not mapped: " << d->notMapped         << endl;
@@ -265,21 +360,8 @@ string printIndvDat(  indvDat * d ){
 
   int z = 0;
 
-  for(vector< BamAlignment >::iterator it = d->alignments.begin(); it != d->alignments.end(); it++){
-   
-    ss   << " " << (*it).Name << " " 
-         << d->badFlag[z] << " "
-         << (*it).RefID    << " " 
-	 << (*it).Position << " " 
-	 << (*it).GetEndPosition(false,true) << " "
-	 << (*it).Position + (*it).Length << " "
-         << (*it).MapQuality << " " 
-         << (*it).MateRefID    << " " 
-         << (*it).MatePosition << " " 
-	 << collapseCigar((*it).CigarData) << " " 
-         << (*it).AlignmentFlag << " " 
-	 << (*it).QueryBases 
-	 << endl;
+  for(vector< string >::iterator it = d->alignments.begin(); it != d->alignments.end(); it++){
+    ss   << " " << d->badFlag[z] << " " << (*it) << endl;
     z++;
   }
 
@@ -307,6 +389,8 @@ void printVersion(void){
 void printHelp(void){
   cerr << "usage  : WHAM-BAM -m <STRING> -x <INT> -r <STRING>     -e <STRING>  -t <STRING>    -b <STRING>   " << endl << endl;
   cerr << "example: WHAM-BAM -m microSat_and_simpleRep_hg19.wham.masking.txt -x 20 -r chr1:0-10000 -e genes.bed -t a.bam,b.bam -b c.bam,d.bam" << endl << endl; 
+  cerr << "masking: WHAM-BAM mask-build <kmers.txt> <kmers.bin>  -- packs the kmer database for -m" << endl << endl;
+  cerr << "extract: WHAM-BAM extract <in.bam> <out.wev>    -- keeps the reads WHAM-BAM uses; the .wev can stand in for the bam in -t and -b" << endl << endl;
 
   cerr << "required   : t <STRING> -- comma separated list of target bam files"           << endl ;
   cerr << "recommended: m <STRING> -- kmer database for downstream filtering"             << endl ; 
@@ -314,6 +398,12 @@ void printHelp(void){
   cerr << "option     : r <STRING> -- a genomic region in the format \"seqid:start-end\"" << endl ;
   cerr << "option     : x <INT>    -- set the number of threads, otherwise max          " << endl ; 
   cerr << "option     : e <STRING> -- a bedfile that defines regions to score           " << endl ; 
+  cerr << "option     : a          -- assemble a contig at each breakpoint                " << endl ; 
+  cerr << "option     : w <INT>    -- score clipped positions up to INT bp apart once [5]" << endl ; 
+  cerr << "option     : s <INT>    -- --seed, seeds the genotype read sampling; otherwise the clock" << endl ; 
+  cerr << "option     : d <INT>    -- --max-depth, downsample past INT reads over all bams [off]" << endl ; 
+  cerr << "option     : --no-stats-cache -- sample insert lengths again, ignoring <bam>.wham.stats" << endl ; 
+  cerr << "option     : --two-phase -- find clipped sites bam by bam, pool them, then genotype only those" << endl ; 
   cerr << endl;
   printVersion();
 }
@@ -321,10 +411,16 @@ void printHelp(void){
 void parseOpts(int argc, char** argv){
   int opt = 0;
 
-  globalOpts.mask = "NA";
-  globalOpts.bed  = "NA";
+  globalOpts.mask     = "NA";
+  globalOpts.bed      = "NA";
+  globalOpts.assemble = false;
+  globalOpts.clipWindow = 5;
+  globalOpts.seed     = (unsigned long) time(NULL);
+  globalOpts.maxDepth = 0;
+  globalOpts.statsCache = true;
+  globalOpts.twoPhase   = false;
 
-  opt = getopt(argc, argv, optString);
+  opt = getopt_long(argc, argv, optString, longOpts, NULL);
 
   while(opt != -1){
     switch(opt){
@@ -334,6 +430,50 @@ void parseOpts(int argc, char** argv){
 	cerr << "INFO: WHAM-BAM will screen breakpoints for simple repeats and microstats: " << globalOpts.mask << endl;
 	break;
       }
+    case 'a':
+      {
+	globalOpts.assemble = true;
+	cerr << "INFO: WHAM-BAM will assemble contigs at breakpoints" << endl;
+	break;
+      }
+    case 'w':
+      {
+	globalOpts.clipWindow = atoi(optarg);
+	if(globalOpts.clipWindow < 0){
+	  cerr << "FATAL: the clip window (-w) cannot be negative." << endl;
+	  cerr << "FATAL: wham is now exiting."          << endl;
+	  exit(1);
+	}
+	cerr << "INFO: WHAM-BAM will score clipped positions up to " << globalOpts.clipWindow << " bp apart together" << endl;
+	break;
+      }
+    case 's':
+      {
+	globalOpts.seed = strtoul(optarg, NULL, 10);
+	break;
+      }
+    case 'd':
+      {
+	globalOpts.maxDepth = atoi(optarg);
+	if(globalOpts.maxDepth < 1){
+	  cerr << "FATAL: the maximum depth (--max-depth) must be at least one." << endl;
+	  cerr << "FATAL: wham is now exiting."          << endl;
+	  exit(1);
+	}
+	cerr << "INFO: WHAM-BAM will downsample reads past a depth of " << globalOpts.maxDepth << endl;
+	break;
+      }
+    case 'S':
+      {
+	globalOpts.statsCache = false;
+	break;
+      }
+    case 'P':
+      {
+	globalOpts.twoPhase = true;
+	cerr << "INFO: WHAM-BAM will find candidate sites in each bam alone, then genotype them together" << endl;
+	break;
+      }
     case 'e':
       {
 	globalOpts.bed = optarg;
@@ -394,7 +534,7 @@ void parseOpts(int argc, char** argv){
       exit(1);
     }
     }
-    opt = getopt( argc, argv, optString );
+    opt = getopt_long( argc, argv, optString, longOpts, NULL );
   }
   if( globalOpts.targetBams.empty() && globalOpts.backgroundBams.empty() ){
     cerr << "FATAL: Failure to specify target and/or background bam files." << endl;
@@ -415,42 +555,118 @@ double bound(double v){
 }
 
 
-double mean(vector<double> & data){
+// numbers the distinct BAM files once; a file listed twice is one
+// sample
 
-  double sum = 0;
-  double n   = 0;
+void resolveSamples(void){
 
-  for(vector<double>::iterator it = data.begin(); it != data.end(); it++){
-    sum += (*it);
-    n += 1;
+  map<string, int> ids;
+
+  globalOpts.samples.clear();
+  globalOpts.sampleIds.clear();
+
+  for(vector<string>::iterator it = globalOpts.all.begin();
+      it != globalOpts.all.end(); it++){
+    if(ids.find(*it) == ids.end()){
+      int id = globalOpts.samples.size();
+      ids[*it] = id;
+      globalOpts.samples.push_back(*it);
+    }
+    globalOpts.sampleIds.push_back(ids[*it]);
   }
-  return sum / n;
 }
 
-double var(vector<double> & data, double mu){
-  double variance = 0;
+// sets and reports the statistics of one sample
 
-  for(vector<double>::iterator it = data.begin(); it != data.end(); it++){
-    variance += pow((*it) - mu,2);
+void storeInsertStats(int sample, const insertStats & stats, 
+		      const string & reusedFrom){
+
+  string & targetfile = globalOpts.samples[sample];
+
+  if((int) stats.groups.size() != readGroups.count(sample)){
+    cerr << "FATAL: the read groups sampled do not match the header of: " << targetfile << endl;
+    exit(1);
+  }
+
+  omp_set_lock(&lock);
+
+  insertDists.mus[  sample ]  = stats.mu;
+  insertDists.sds[  sample ]  = stats.sd;
+  insertDists.avgD[ sample ] = stats.avgD;
+  sampleStats[ sample ]      = stats;
+
+  for(unsigned int g = 0; g < stats.groups.size(); g++){
+    insertDists.lowCut[  readGroups.first(sample) + g ] = stats.groups[g].lowCut;
+    insertDists.highCut[ readGroups.first(sample) + g ] = stats.groups[g].highCut;
   }
 
-  return variance / (data.size() - 1);
+  cerr << "INFO: for file:" << targetfile << endl;
+  if(! reusedFrom.empty()){
+    cerr << "     " << targetfile << ": reused from: " << reusedFrom << endl;
+  }
+  cerr << "     " << targetfile << ": mean depth: " << stats.avgD << endl
+       << "     " << targetfile << ": sd   depth: " << stats.sdD << endl
+       << "     " << targetfile << ": mean insert length: " << insertDists.mus[sample] << endl
+       << "     " << targetfile << ": sd   insert length: " << insertDists.sds[sample] << endl
+       << "     " << targetfile << ": number of reads used: " << stats.nReads  << endl;
+  for(vector<groupStats>::const_iterator it = stats.groups.begin();
+      it != stats.groups.end(); it++){
+    cerr << "     " << targetfile << ": read group " << (it->id.empty() ? "(none)" : it->id) 
+	 << ": inserts outside " << it->lowCut << "-" << it->highCut << " are odd"
+	 << " (" << it->nReads << " reads" 
+	 << (it->nReads < STATS_MIN_GROUP_READS ? ", too few; mean +/- 3 sd" : "") << ")" << endl;
+  }
+  cerr << endl;
+       
+  omp_unset_lock(&lock);
 }
 
-// gerates per bamfile statistics 
+// the header text and references of a bam or an evidence file
 
-void grabInsertLengths(string targetfile){
+bool readHeader(const string & file, string & headerText, RefVector & refs){
 
-  vector<string> target_group ;
-  target_group.push_back(targetfile);
-  
-  vector<double> alIns;
-  vector<double> nReads;
+  if(evidenceReader::isEvidence(file)){
+    evidenceReader evidence;
+    if(! evidence.open(file)){
+      return false;
+    }
+    headerText = evidence.headerText();
+    refs       = evidence.references();
+    return true;
+  }
+
+  BamReader bamR;
+  if(! bamR.Open(file)){
+    return false;
+  }
+  headerText = bamR.GetHeaderText();
+  refs       = bamR.GetReferenceData();
+  bamR.Close();
+  return true;
+}
+
+// gerates per bamfile statistics, or reads them back from the sidecar
+// an earlier run left next to the bam; an evidence file carries those
+// of the bam it was extracted from
+
+void grabInsertLengths(int sample){
+
+  string & targetfile = globalOpts.samples[sample];
+
+  if(evidenceReader::isEvidence(targetfile)){
+    evidenceReader evidence;
+    if(! evidence.open(targetfile)){
+      cerr << "FATAL: cannot read evidence file: " << targetfile << ": " << evidence.error << endl;
+      exit(1);
+    }
+    storeInsertStats(sample, evidence.libraryStats(), targetfile);
+    return;
+  }
 
-  BamMultiReader bamR;
-  if(!bamR.Open(target_group) && bamR.LocateIndexes() ){
+  BamReader bamR;
+  if(! bamR.Open(targetfile)){
     cerr << "FATAL: cannot read - or find index for: " << targetfile << endl;
-    exit(0);
+    exit(1);
   }
 
   SamHeader SH = bamR.GetHeader();
@@ -459,88 +675,42 @@ void grabInsertLengths(string targetfile){
     exit(1);
   }
 
-  RefVector sequences = bamR.GetReferenceData();
+  string headerText = bamR.GetHeaderText();
 
   bamR.Close();
 
-  int i = 0; // index for while loop
-  int n = 0; // number of reads
-  
-  BamAlignment al;
+  insertStats stats;
 
-  while(i < 3 || n < 20000){
+  if(globalOpts.statsCache 
+     && loadInsertStats(targetfile, headerText, stats)){
+    storeInsertStats(sample, stats, insertStatsPath(targetfile));
+    return;
+  }
 
-    const int randomChr = rand() % (sequences.size() -1);
-    const int randomPos = rand() % (sequences[randomChr].RefLength -1);
-    const int randomEnd = randomPos + 10000;
+  long int nWindows = 0;
 
-    if(randomEnd > sequences[randomChr].RefLength){
-      continue; 
-    }
-    if(sequences[randomChr].RefLength < 10000){
-      cerr << "FATAL: Trying to randomly sample depth from the first seqid: " << sequences[randomChr].RefName << endl;
-      cerr << "      " << sequences[randomChr].RefName << " is " << sequences[randomChr].RefLength << " bp "; 
-      cerr << "       Current wham needs the seqid to be longer than 10kb, please contact zev kronenberg if you get this error" << endl << endl;                 
-    }
-    
-    BamMultiReader bamR;
-    if(!bamR.Open(target_group) && bamR.LocateIndexes() ){
-      cerr << "FATAL: cannot read - or find index for: " << targetfile << endl;
-      exit(0);
-    }
-    if(! bamR.SetRegion(0, randomPos, 0, randomEnd)){      
-      continue;
-    }
-        
-    if(!bamR.GetNextAlignmentCore(al)){
-      continue;
-    }
+  if(! sampleLibrary(targetfile, stats, &nWindows)){
+    cerr << "FATAL: cannot read - or find index for: " << targetfile << endl;
+    exit(1);
+  }
+  if(stats.nReads < 2){
+    cerr << "FATAL: no paired reads found in " << nWindows << " windows of: " << targetfile << endl;
+    exit(1);
+  }
 
-    i++;
-    
-    long int cp = al.GetEndPosition(false,true);
-    
-    readPileUp allPileUp;
-    
-    while(bamR.GetNextAlignmentCore(al)){
-      if(al.Position > cp){
-	allPileUp.purgePast(&cp);
-	cp = al.Position;
-	nReads.push_back(allPileUp.currentData.size());
-      }
-      if(al.IsMapped()
-	 && al.IsMateMapped() 
-	 && abs(double(al.InsertSize)) < 10000 
-	 && al.RefID == al.MateRefID
-	 ){	
-	allPileUp.processAlignment(al);
-	alIns.push_back(abs(double(al.InsertSize)));
-	n++;
-      }
-    }
-    bamR.Close();
+  if(globalOpts.statsCache
+     && ! saveInsertStats(targetfile, headerText, stats)){
+    omp_set_lock(&lock);
+    cerr << "WARNING: could not write " << insertStatsPath(targetfile) 
+	 << "; the next run will sample it again" << endl;
+    omp_unset_lock(&lock);
   }
 
-  double mu       = mean(alIns        );
-  double mud      = mean(nReads       );
-  double variance = var(alIns, mu     );
-  double sd       = sqrt(variance     );
-  double sdd      = var(nReads, mud   );
-  
   omp_set_lock(&lock);
-
-  insertDists.mus[  targetfile ]  = mu;
-  insertDists.sds[  targetfile ]  = sd;
-  insertDists.avgD[ targetfile ] = mud;
-
-  cerr << "INFO: for file:" << target_group[0] << endl            
-       << "     " << target_group[0] << ": mean depth: " << mud << endl
-       << "     " << target_group[0] << ": sd   depth: " << sdd << endl
-       << "     " << target_group[0] << ": mean insert length: " << insertDists.mus[target_group[0]] << endl
-       << "     " << target_group[0] << ": sd   insert length: " << insertDists.sds[target_group[0]] << endl
-       << "     " << target_group[0] << ": number of reads used: " << n  << endl << endl;
-       
+  cerr << "INFO: sampled " << nWindows << " windows of: " << targetfile << endl;
   omp_unset_lock(&lock);
+
+  storeInsertStats(sample, stats, "");
 }
 
 void prepBams(BamMultiReader & bamMreader, string group){
@@ -619,81 +789,74 @@ double totalLL(vector<double> & data, double alpha, double beta){
 }
 
 
-double unphred(double p){
-  return pow(10, (-p/10));
-}
-
-bool processGenotype(string & fname,
-		     indvDat * idat, 
-		     double * totalAlt, 
-		     double * totalAltGeno,
-		     double * relativeDepth,
-		     insertDat * stats){
-
-  string genotype = "./.";
+// tallies the sampled reads of a sample by MAPQ and allele for the
+// likelihood kernel.  A sample with fewer than three reads is not
+// genotyped.
 
-  long double aal = 0;
-  long double abl = 0;
-  long double bbl = 0;
+void tallyGenotype(int sample, indvDat * idat, glKernel & kernel){
 
-  if(idat->badFlag.size() < 3){
-    idat->gls.push_back(-255.0);
-    idat->gls.push_back(-255.0);
-    idat->gls.push_back(-255.0);
-    return true;
+  if(idat->nReads < 3){
+    return;
   }
 
   double nref = 0.0;
   double nalt = 0.0;
 
-  if(idat->badFlag.size() > 1000){
-    std::random_shuffle ( idat->badFlag.begin(), idat->badFlag.end() );
-  }
-
   int ri = 0;
  
   for(vector< int >::iterator rit = idat->badFlag.begin(); rit != idat->badFlag.end(); rit++){
-    if(ri > 1000){
-      break;
-    }
-
-    double mappingP = unphred(idat->MapQ[ri]);
 
     // will this improve stuff 1-> 2?
 
-    if( (*rit == 1 && idat->nClipping > 1) ){
+    bool alt = (*rit == 1 && idat->nClipping > 1);
+
+    if(alt){
       nalt += 1;
-      aal += log((2-2) * (1-mappingP) + (2*mappingP)) ;
-      abl += log((2-1) * (1-mappingP) + (1*mappingP)) ;
-      bbl += log((2-0) * (1-mappingP) + (0*mappingP)) ;
     }
     else{
       nref += 1;
-      aal += log((2 - 2)*mappingP + (2*(1-mappingP)));
-      abl += log((2 - 1)*mappingP + (1*(1-mappingP)));
-      bbl += log((2 - 0)*mappingP + (0*(1-mappingP)));
     }
+    kernel.add(sample, idat->MapQ[ri], alt);
     ri++;
   }
 
   idat->nBad  = nalt;
   idat->nGood = nref;
+}
+
+// calls the genotype from the kernel's log-likelihoods
+
+bool processGenotype(int sample,
+		     indvDat * idat, 
+		     const double * ll,
+		     double * totalAlt, 
+		     double * totalAltGeno,
+		     double * relativeDepth,
+		     insertDat * stats){
 
-  double nreads = idat->nReads;
+  string genotype = "./.";
 
-  if(nreads > 1000){
-    nreads = 1000;
+  if(idat->nReads < 3){
+    idat->gls.push_back(-255.0);
+    idat->gls.push_back(-255.0);
+    idat->gls.push_back(-255.0);
+    return true;
   }
 
-  aal = aal - log(pow(2,nreads)); // the normalization of the genotype likelihood
-  abl = abl - log(pow(2,nreads)); // this is causing underflow for really high depth.
-  bbl = bbl - log(pow(2,nreads));
+  double nreads = idat->badFlag.size();
+
+  // the normalization of the genotype likelihood, log(2^n), taken
+  // without forming 2^n
 
-  if(nref == 0){
+  long double aal = ll[0] - nreads * M_LN2;
+  long double abl = ll[1] - nreads * M_LN2;
+  long double bbl = ll[2] - nreads * M_LN2;
+
+  if(idat->nGood == 0){
     aal = -255.0;
     abl = -255.0;
   }
-  if(nalt == 0){
+  if(idat->nBad == 0){
     abl = -255.0;
     bbl = -255.0;
   }
@@ -714,7 +877,7 @@ bool processGenotype(string & fname,
     (*totalAlt) += 2;
   }
   if(idat->genotypeIndex != 0){
-    *relativeDepth += (idat->badFlag.size() / stats->avgD[fname]);
+    *relativeDepth += (idat->nReads / stats->avgD[sample]);
     *totalAltGeno += 1;
   }
 
@@ -724,11 +887,9 @@ bool processGenotype(string & fname,
   idat->gls.push_back(bbl);
 
 #ifdef DEBUG
-   cerr << genotype << "\t" << aal << "\t" << abl << "\t" << bbl << "\t" << nref << "\t"  << endl;
+   cerr << genotype << "\t" << aal << "\t" << abl << "\t" << bbl << "\t" << idat->nGood << "\t"  << endl;
 #endif
   return true;
-
- 
 }
 
 bool checkN(string & s){
@@ -758,117 +919,159 @@ bool checkN(string & s){
   return false;
 }
 
-bool loadIndv(map<string, indvDat*> & ti, 
+// where the n-th read (from zero) of a sample goes in its reservoir of
+// GENOTYPE_MAX_READS, or -1 when it is not kept.  Every read ends up
+// kept with the same chance, and a deep sample never holds more than
+// the cap.
+
+int reservoirSlot(int n, siteRandom & rng){
+  if(n < GENOTYPE_MAX_READS){
+    return n;
+  }
+  uint32_t j = rng.below(n + 1);
+  if(j < GENOTYPE_MAX_READS){
+    return j;
+  }
+  return -1;
+}
+
+bool loadIndv(vector<indvDat> & ti, 
 	      readPileUp & pileup, 
-	      global_opts & localOpts, 
+	      const global_opts & localOpts, 
 	      insertDat & localDists, 
-	      long int * pos
-	      
+	      long int * pos,
+	      siteRandom & rng
 	      ){    
 
   
-  for(list<BamAlignment>::iterator r = pileup.currentData.begin(); r != pileup.currentData.end(); r++){
+  for(size_t i = 0; i < pileup.currentData.size(); i++){
+
+    whamRead * r = &pileup.currentData[i];
    
-    if((*r).Position > *pos){
+    if((*r).position > *pos || (*r).end < *pos){
       continue;
     }
 
-    if( ((*r).AlignmentFlag & 0x0800) != 0 || ! (*r).IsPrimaryAlignment()){
+    if( (*r).isSupplementary() || ! (*r).isPrimaryAlignment()){
       continue;
     }
 
-    string fname = (*r).Filename;
+    int       sample = localOpts.sampleIds[(*r).sample];
+    indvDat & indv   = ti[sample];
 
     int bad = 0;
 
-    vector< CigarOp > cd = (*r).CigarData;
-
-    if( ((pileup.primary[(*r).Position].size() > 1) || (pileup.primary[(*r).GetEndPosition(false,true)].size() > 1))
-	&& (cd.front().Type == 'S' || cd.back().Type == 'S') ){
+    if( ((pileup.primary.at((*r).position).size() > 1) || (pileup.primary.at((*r).end).size() > 1))
+	&& ((*r).frontType == 'S' || (*r).backType == 'S') ){
       bad = 1;
-      ti[fname]->nClipping++;
+      indv.nClipping++;
     }
     
-    if((*r).IsMapped() && (*r).IsMateMapped() && ((*r).RefID == (*r).MateRefID)){
+    if((*r).isMateMapped() && ((*r).refId == (*r).mateRefId)){
 
-      ti[fname]->insertSum    += abs(double((*r).InsertSize));
-      ti[fname]->mappedPairs  += 1;
+      indv.insertSum    += abs(double((*r).insertSize));
+      indv.mappedPairs  += 1;
       
-      if(( (*r).IsReverseStrand() && (*r).IsMateReverseStrand() ) || ( !(*r).IsReverseStrand() && !(*r).IsMateReverseStrand() )){
+      if(( (*r).isReverseStrand() && (*r).isMateReverseStrand() ) || ( !(*r).isReverseStrand() && !(*r).isMateReverseStrand() )){
 	bad = 1;
-	ti[fname]->sameStrand += 1;
+	indv.sameStrand += 1;
       }
       
-      double ilength = abs ( double ( (*r).InsertSize ));
+      double ilength = abs ( double ( (*r).insertSize ));
       
-      double iDiff = abs ( ilength - localDists.mus[(*r).Filename] );
+      indv.inserts.push_back(ilength);
       
-      ti[fname]->inserts.push_back(ilength);
-      
-      if(iDiff > ( 3.0 * insertDists.sds[(*r).Filename] ) ){
+      if(ilength < localDists.lowCut[(*r).readGroup] 
+	 || ilength > localDists.highCut[(*r).readGroup]){
 	bad = 1;
-	ti[fname]->nAboveAvg += 1;
-	ti[fname]->hInserts.push_back(ilength);
+	indv.nAboveAvg += 1;
+	indv.hInserts.push_back(ilength);
       
-	if( ilength < localDists.mus[(*r).Filename]){
+	if( ilength < localDists.lowCut[(*r).readGroup]){
 	  pileup.mateTooClose++;
 	}
-	if( ilength > localDists.mus[(*r).Filename] ){
-
+	else{
 	  pileup.mateTooFar++;
 	}
       }
     }
 
-    ti[fname]->nReads++;
-
-    map<string, int>::iterator os = pileup.odd.find((*r).Name);
-
-    if(os !=  pileup.odd.end()){
+    if(pileup.isOdd(*r)){
       bad = 1;
     }
 
     if(bad == 1){
-      ti[fname]->nBad += 1;
+      indv.nBad += 1;
+    }
+    else{
+      indv.nGood += 1;
+    }
+
+    int slot = reservoirSlot(indv.nReads, rng);
+
+    indv.nReads++;
+
+    if(slot < 0){
+      continue;
+    }
+    if(slot == (int) indv.badFlag.size()){
+      indv.badFlag.push_back( bad );
+      indv.MapQ.push_back((*r).mapQ);
     }
     else{
-      ti[fname]->nGood += 1;
+      indv.badFlag[slot] = bad;
+      indv.MapQ[slot]    = (*r).mapQ;
     }
-    ti[fname]->badFlag.push_back( bad );
 #ifdef DEBUG
-    ti[fname]->alignments.push_back(*r);
+    stringstream dl;
+    dl << pileup.strings.str((*r).name) << " "
+       << (*r).refId       << " " 
+       << (*r).position    << " " 
+       << (*r).end         << " "
+       << (*r).mapQ        << " " 
+       << (*r).mateRefId   << " " 
+       << (*r).matePosition << " " 
+       << (*r).frontLength << (*r).frontType << ".." 
+       << (*r).backLength  << (*r).backType  << " " 
+       << (*r).flag        << " " 
+       << pileup.strings.str((*r).bases);
+    if(slot == (int) indv.alignments.size()){
+      indv.alignments.push_back(dl.str());
+    }
+    else{
+      indv.alignments[slot] = dl.str();
+    }
 #endif
-    ti[fname]->MapQ.push_back((*r).MapQuality);
   }
   return true;
 }
 
 
-bool cleanUp( map < string, indvDat*> & ti, global_opts localOpts){
-  for(vector<string>::iterator all = localOpts.all.begin(); all != localOpts.all.end(); all++ ){
-    delete ti[*all];
-  }
-  return true;
-}
+bool loadInfoField(vector<indvDat> & dat, info_field * info, const global_opts & opts){
 
-bool loadInfoField(map<string, indvDat*> dat, info_field * info, global_opts & opts){
+  // all lists the targets, then the background
   
   for(unsigned int b = 0; b < opts.backgroundBams.size(); b++){
 
-    if( dat[opts.backgroundBams[b]]->genotypeIndex == -1){
+    indvDat & d = dat[opts.sampleIds[opts.targetBams.size() + b]];
+
+    if( d.genotypeIndex == -1){
       continue;
     }
-    info->nat += 2 - dat[opts.backgroundBams[b]]->genotypeIndex;
-    info->nbt +=     dat[opts.backgroundBams[b]]->genotypeIndex;
+    info->nat += 2 - d.genotypeIndex;
+    info->nbt +=     d.genotypeIndex;
     info->tgc += 1;
   }
 
   for(unsigned int t = 0; t < opts.targetBams.size(); t++){
-    if(dat[opts.targetBams[t]]->genotypeIndex == -1){
+
+    indvDat & d = dat[opts.sampleIds[t]];
+
+    if(d.genotypeIndex == -1){
       continue;
     }
-    info->nab += 2 - dat[opts.targetBams[t]]->genotypeIndex;
-    info->nbb +=     dat[opts.targetBams[t]]->genotypeIndex;
+    info->nab += 2 - d.genotypeIndex;
+    info->nbb +=     d.genotypeIndex;
     info->bgc += 1;
   }
 
@@ -912,130 +1115,8 @@ string infoText(info_field * info){
 
 }
 
-bool burnCigar(string s, vector<cigar> & cigs){
-  
-  unsigned int offset = 0;
-  unsigned int index  = 0; 
-
-  for(string::iterator it = s.begin() ; it != s.end(); it++){
-
-    switch(*it){
-    case 'M':
-      {
-	cigar c;
-	c.type   = 'M';
-	c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'I':
-      {
-        cigar c;
-	c.type   = 'I';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'D':
-      {
-        cigar c;
-	c.type   = 'D';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'N':
-      {
-        cigar c;
-	c.type   = 'N';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'S':
-      {
-        cigar c;
-	c.type   = 'S';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'H':
-      {
-        cigar c;
-	c.type   = 'H';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'P':
-      {
-        cigar c;
-	c.type   = 'P';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    case 'X':
-      {
-        cigar c;
-	c.type   = 'X';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      } 
-    case '=':
-      {
-        cigar c;
-	c.type   = '=';
-        c.length = atoi(s.substr(offset, index-offset).c_str());
-	cigs.push_back(c);
-	offset = index + 1;
-	break;
-      }
-    default:
-      break;
-    }
-    index += 1;
-  }
-  //cerr << "done burning" << endl;
-  return true;
-}
-
-void endPos(vector<cigar> & cigs, long int * pos){
-  
-  for(vector<cigar>::iterator it = cigs.begin(); 
-      it != cigs.end(); it++){
-    
-    switch( (*it).type ){
-    case 'I':
-      {
-	*pos += (*it).length;
-	break;
-      }
-    case 'M':
-      {
-	*pos += (*it).length;
-	break;
-      }
-    default:
-      break;
-    }
-  }
-}
-
-
-
 int SplitReadEndFinder(long int * pos,
-	       map<long int, vector < BamAlignment > > & supliment, 
+	       readPileUp & pileup,
 	       string & bestEnd,
 	       string & bestSeqid,
 	       int * support,
@@ -1044,10 +1125,12 @@ int SplitReadEndFinder(long int * pos,
 	       ){
   
 #ifdef DEBUG
-  cerr << "N secondary:" << supliment.size() << endl;
+  cerr << "N secondary:" << pileup.supplement.size() << endl;
 #endif
 
-  if(supliment[*pos].empty()){
+  clusterRange supliment = pileup.supplement.at(*pos);
+
+  if(supliment.empty()){
     return 0;
   }
 
@@ -1058,54 +1141,30 @@ int SplitReadEndFinder(long int * pos,
   cerr << "Chimeric mapping:" << endl;
 #endif
 
-  for(vector<BamAlignment>::iterator it = supliment[*pos].begin(); 
-      it != supliment[*pos].end(); it++){
+  for(const clusterEntry * c = supliment.first; c != supliment.last; c++){
 
-    string saTag;
-    if(! (*it).GetTag("SA", saTag)){
+    whamRead & r = pileup.read((*c).serial);
+
+    if(r.sa.length == 0){
       cerr << "FATAL::INTERNAL: no sa\n";
       exit(1);
     }
     
 #ifdef DEBUG
-    cerr << saTag << endl;
+    cerr << pileup.strings.str(r.sa) << endl;
 #endif
 
-    vector<string> saInfo = split(saTag, ";");
+    otherAlignment * chimera = pileup.saEntries(r);
 
-    for(vector<string>::iterator ch = saInfo.begin(); 
-	ch != saInfo.end(); ch++){
-      
-      if((*ch).empty()){
-	break;
-      }
-      
-      vector<string> chimera  = split((*ch), ",");
-
-      vector<cigar> c;
+    for(int ch = 0; ch < r.nSa; ch++){
 
-      burnCigar(chimera[3], c);
+      string otherSeqid = pileup.strings.str(chimera[ch].seqid);
 
-      if(c.front().type == 'S'){
-	if(otherPositions[chimera[0]].find(atoi(chimera[1].c_str())) 
-	   == otherPositions[chimera[0]].end()){
-	  otherPositions[chimera[0]][atoi(chimera[1].c_str())] = 1;
-	}
-	else{
-	  otherPositions[chimera[0]][atoi(chimera[1].c_str())]++;
-	}
+      if(chimera[ch].frontType == 'S'){
+	otherPositions[otherSeqid][chimera[ch].pos]++;
       } 
-      if(c.back().type  == 'S'){
-	long int endP = atoi(chimera[1].c_str());
-	endPos(c, &endP);
-	if(otherPositions[chimera[0]].find(endP) ==
-	   otherPositions[chimera[0]].end()
-	   ){
-	  otherPositions[chimera[0]][endP] = 1;	
-	}
-	else{
-	  otherPositions[chimera[0]][endP]++;	
-	}
+      if(chimera[ch].backType  == 'S'){
+	otherPositions[otherSeqid][chimera[ch].end]++;
       } 
     }
   }
@@ -1159,7 +1218,7 @@ int SplitReadEndFinder(long int * pos,
 
 //XATAG
 int otherBreakAlternative(long int * pos,
-			  map<long int, vector < BamAlignment > > & supliment, 
+			  readPileUp & pileup,
 			  string & bestEnd,
 			  string & bestSeqid,
 			  int * support,
@@ -1167,8 +1226,10 @@ int otherBreakAlternative(long int * pos,
 			  string & currentSeqid			  
 	       ){
   
+  clusterRange supliment = pileup.primary.at(*pos);
+
 #ifdef DEBUG
-  cerr << "N alternative:" << supliment[*pos].size() << endl;
+  cerr << "N alternative:" << supliment.size() << endl;
 #endif
 
  
@@ -1178,60 +1239,29 @@ int otherBreakAlternative(long int * pos,
   cerr << "Alternative mapping:" << endl;
 #endif
 
-  for(vector<BamAlignment>::iterator it = supliment[*pos].begin(); 
-      it != supliment[*pos].end(); it++){
+  for(const clusterEntry * c = supliment.first; c != supliment.last; c++){
+
+    whamRead & r = pileup.read((*c).serial);
 
 #ifdef DEBUG
-    cerr << (*it).Name << endl;
+    cerr << pileup.strings.str(r.name) << endl;
 #endif
     
-    string saTag;
-    if(!(*it).GetTag("XA", saTag)){
-      continue;
-    }
-    
-    vector<string> xaInfo = split(saTag, ";");
-    
-    for(vector<string>::iterator ch = xaInfo.begin(); 
-	ch != xaInfo.end(); ch++){
-      
-      if((*ch).empty()){
-	break;
-      }
+    otherAlignment * chimera = pileup.xaEntries(r);
+
+    for(int ch = 0; ch < r.nXa; ch++){
       
 #ifdef DEBUG
-      cerr << saTag << endl;
+      cerr << pileup.strings.str(r.xa) << endl;
 #endif
 
-      vector<string> chimera  = split((*ch), ",");
-
-      // remove the strand from XA
-      chimera[1].erase(0,1); 
-
-      vector<cigar> c;
-
-      burnCigar(chimera[2], c);
+      string otherSeqid = pileup.strings.str(chimera[ch].seqid);
 
-      if(c.front().type == 'S'){
-	if(otherPositions[chimera[0]].find(atoi(chimera[1].c_str())) 
-	   == otherPositions[chimera[0]].end()){
-	  otherPositions[chimera[0]][atoi(chimera[1].c_str())] = 1;
-	}
-	else{
-	  otherPositions[chimera[0]][atoi(chimera[1].c_str())]++;
-	}
+      if(chimera[ch].frontType == 'S'){
+	otherPositions[otherSeqid][chimera[ch].pos]++;
       } 
-      if(c.back().type  == 'S'){
-	long int endP = atoi(chimera[1].c_str());
-	endPos(c, &endP);
-	if(otherPositions[chimera[0]].find(endP) ==
-	   otherPositions[chimera[0]].end()
-	   ){
-	  otherPositions[chimera[0]][endP] = 1;
-	}
-	else{
-	  otherPositions[chimera[0]][endP]++;
-	}
+      if(chimera[ch].backType  == 'S'){
+	otherPositions[otherSeqid][chimera[ch].end]++;
       } 
     }
   }
@@ -1285,37 +1315,56 @@ int otherBreakAlternative(long int * pos,
 
 }
 
-bool uniqClips(long int * pos, 
-	       map<long int, vector < BamAlignment > > & clusters, 
-	       vector<string> & alts, string & direction){
+// the clips of every read clipped in the group, so reads the aligner
+// clipped a few bases off the breakpoint still count
+
+bool uniqClips(const clipGroup & group, 
+	       readPileUp & pileup,
+	       const vector<uint32_t> & serials,
+	       vector<clippedSequence> & alts, string & direction){
 
-  map<string, vector<string> >  clippedSeqs;
+  map<string, vector<clippedSequence> >  clippedSeqs;
 
   int bcount = 0;
   int fcount = 0;
 
-  for( vector < BamAlignment >::iterator it = clusters[(*pos)].begin(); 
-       it != clusters[(*pos)].end(); it++){
+  for(vector<uint32_t>::const_iterator c = serials.begin(); 
+      c != serials.end(); c++){
+
+    whamRead & r = pileup.read(*c);
     
-    if(((*it).AlignmentFlag & 0x0800) != 0 || !(*it).IsPrimaryAlignment()){
+    if(r.isSupplementary() || !r.isPrimaryAlignment()){
       continue;
     }
     
-    vector< CigarOp > cd = (*it).CigarData;
-  
-    if((*it).Position == (*pos)){
-      string clip = (*it).QueryBases.substr(0, cd.front().Length);
-      if(clip.size() < 10){
+    // clips are cut from the stored strings by their own lengths, so
+    // they stay inside them whatever the read's length
+
+    if(group.side != 'b' && r.frontType == 'S' 
+       && r.position >= group.first && r.position <= group.last
+       && r.frontLength <= r.bases.length){
+      clippedSequence clip;
+      clip.bases.assign(pileup.strings.at(r.bases), r.frontLength);
+      if(clip.bases.size() < 10){
 	continue;
       }
+      if(r.quals.length >= r.frontLength){
+	clip.quals.assign(pileup.strings.at(r.quals), r.frontLength);
+      }
       clippedSeqs["f"].push_back(clip);
       fcount += 1;
     }
-    if((*it).GetEndPosition(false,true) == (*pos)){
-      string clip = (*it).QueryBases.substr( (*it).Length - cd.back().Length );
-      if(clip.size() < 10){
+    if(group.side != 'f' && r.backType == 'S' 
+       && r.end >= group.first && r.end <= group.last
+       && r.backLength <= r.bases.length){
+      clippedSequence clip;
+      clip.bases.assign(pileup.strings.at(r.bases) + r.bases.length - r.backLength, r.backLength);
+      if(clip.bases.size() < 10){
 	continue;
       }
+      if(r.quals.length >= r.backLength){
+	clip.quals.assign(pileup.strings.at(r.quals) + r.quals.length - r.backLength, r.backLength);
+      }
       clippedSeqs["b"].push_back(clip);    
       bcount += 1;
     }
@@ -1328,7 +1377,7 @@ bool uniqClips(long int * pos,
 
   direction = key;
 
-  for(vector<string>::iterator seqs = clippedSeqs[key].begin();
+  for(vector<clippedSequence>::iterator seqs = clippedSeqs[key].begin();
       seqs != clippedSeqs[key].end(); seqs++
       ){
     alts.push_back(*seqs);
@@ -1339,82 +1388,86 @@ bool uniqClips(long int * pos,
 
 
 
-string consensus(vector<string> & s, double * nn, string & direction){
+// the junction of a read clipped at pos is the first base after the
+// clip boundary
+
+bool addAssemblyRead(microAssembler * assembler, readPileUp & pileup, 
+		     whamRead & r, long int pos){
+
+  int32_t junction = -1;
+
+  if(r.position == pos && r.frontType == 'S'){
+    junction = r.frontLength;
+  }
+  else if(r.end == pos && r.backType == 'S' && r.backLength <= r.bases.length){
+    junction = r.bases.length - r.backLength;
+  }
+  return assembler->addRead(pileup.strings.at(r.bases), r.bases.length, junction);
+}
+
+// assembles the reads clipped at pos, on either side, and the
+// supplementary alignments split there
+
+void assembleBreakpoint(long int pos, readPileUp & pileup, string & contig){
+
+  microAssembler * assembler = assemblers[omp_get_thread_num()];
+
+  assembler->clear();
+
+  bool full = false;
+
+  clusterRange primary = pileup.primary.at(pos);
+
+  for(const clusterEntry * c = primary.first; c != primary.last && ! full; c++){
+    full = ! addAssemblyRead(assembler, pileup, pileup.read((*c).serial), pos);
+  }
+
+  // split primaries are in both clusters
+
+  clusterRange supplement = pileup.supplement.at(pos);
+
+  for(const clusterEntry * c = supplement.first; c != supplement.last && ! full; c++){
+    whamRead & r = pileup.read((*c).serial);
+    if(r.isSupplementary()){
+      full = ! addAssemblyRead(assembler, pileup, r, pos);
+    }
+  }
+
+  assembler->assemble(contig);
+}
+
+// front clips end at the breakpoint and the first ones are used; back
+// clips start there and the last ones are used
+
+string consensus(vector<clippedSequence> & s, double * nn, string & direction){
 
   if(s.empty()){
     return ".";
   }
   
   if(s.size() == 1){
-    return s[0];
+    return s[0].bases;
   }
-  
-  stringstream con;
-  
-  {
-    using namespace seqan;
-   
-    typedef String< Dna > TSequence;
-    typedef Graph<Alignment<StringSet<TSequence, Dependent<> > > > TGraph;
 
-    StringSet<TSequence> seq;
-    
-    int index = 0;
+  vector<clippedSequence> clips;
 
-    if(direction.compare("f") == 0){
-      for(uint clips = 0; clips < s.size(); clips++){
-	appendValue(seq, s[clips]);
-	if(clips > 19){
-	  break;
-	}
-      }
-    }
-    else{
-      for(int clips = s.size() -1; clips > -1; clips--){
-	appendValue(seq, s[clips]);          
-	index+=1;
-	if(index > 19){
-	  break;
-	}
-      }
+  if(direction.compare("f") == 0){
+    for(unsigned int c = 0; c < s.size() && c < CONSENSUS_MAX_CLIPS; c++){
+      clips.push_back(s[c]);
     }
-    TGraph aliG(seq);
-    globalMsaAlignment(aliG, Blosum62(-1, -11));
-
-    String<char> align;
-    convertAlignment(aliG, align);
-    
-    unsigned int nseq   = length(seq);
-    unsigned int colLen = length(align) / nseq;
-    
-    for(unsigned int z = 0 ; z < colLen; z++){
-      map<char, int> columnBases;
-      for(unsigned int s = 0; s < nseq; s++){
-	if(align[z + (s*colLen)] != gapValue<char>()){
-	  columnBases[align[z + (s*colLen)]]++;
-	}
-      }
-      if(columnBases.size() == 1){
-	con << columnBases.begin()->first;
-      }
-      else{
-	*nn += 1;
-	con << "N";
-      }
+  }
+  else{
+    for(int c = s.size() - 1; c > -1 && int(clips.size()) < CONSENSUS_MAX_CLIPS; c--){
+      clips.push_back(s[c]);
     }
-    
-#ifdef DEBUG
-  cerr << "seqAn alignment" << endl;
-  cerr << aliG << endl;
-#endif 
   }
-  
-  return con.str(); 
+
+  return clipConsensus(clips, direction.compare("f") == 0, nn);
 }
 
 bool clusterMatePos(string & seqid, 
 		    long int * pos, 
-		    map<long int, vector < BamAlignment > > & primary,
+		    readPileUp & pileup,
 		    string & bestEnd, 
 		    int * count,
 		    long int * breakpoint
@@ -1426,23 +1479,26 @@ bool clusterMatePos(string & seqid,
  
   map<long int, int>::iterator fm;
 
-  for(vector<BamAlignment>::iterator it = primary[*pos].begin();
-      it != primary[*pos].end(); it++){
+  clusterRange primary = pileup.primary.at(*pos);
+
+  for(const clusterEntry * c = primary.first; c != primary.last; c++){
 
-    if(!(*it).IsMateMapped()){
+    whamRead & r = pileup.read((*c).serial);
+
+    if(!r.isMateMapped()){
       continue;
     }
 
-    if((*it).MateRefID != (*it).MateRefID){
+    if(r.mateRefId != r.mateRefId){
       otherSeqids++;
       continue;
     }
     
-    if(otherPos.find((*it).MatePosition) == otherPos.end()){
-      otherPos[(*it).MatePosition] = 1;
+    if(otherPos.find(r.matePosition) == otherPos.end()){
+      otherPos[r.matePosition] = 1;
     }
     else{
-      otherPos[(*it).MatePosition]++;
+      otherPos[r.matePosition]++;
     }
   }
  
@@ -1470,122 +1526,118 @@ bool clusterMatePos(string & seqid,
   }   
 }
 
-bool score(string seqid, 
-	   long int * pos, 
-	   readPileUp & totalDat, 
-	   insertDat & localDists, 
-	   string & results, 
-	   global_opts localOpts,
-	   vector<uint64_t> & kmerDB
-	   ){
+// the cluster size stage of score(), with at least minClips clipped
+// ends; returns the clipped ends, or 0 when it rejects the group.
+// --two-phase discovery runs it alone on each sample, with a lower
+// minimum, and sums the ends over the samples.
 
-  
-  totalDat.processPileup(pos);
-  
-  if(totalDat.primary[*pos].size() < 3){
-    return true;
-  }
+int clusterStage(const clipGroup & group, 
+		 readPileUp & totalDat, 
+		 vector<uint32_t> & clipped, 
+		 int minClips,
+		 vector<long int> & rejected){
 
-  if(totalDat.nDiscordant == 0 && totalDat.nsplitRead == 0 && totalDat.evert == 0){
-    return true;
-  }
-  
-  if((double(totalDat.nLowMapQ) / double(totalDat.numberOfReads)) == 1){
-    return true;
+  // stage: cluster size.  The buffer counts every clipped read, so too
+  // few there means too few in the clusters.
+
+  if(group.nClipped < minClips){
+    rejected[STAGE_CLUSTER]++;
+    return 0;
   }
 
-  if((double(totalDat.nPaired) / double(totalDat.numberOfReads)) == 1
-     && (double(totalDat.nLowMapQ) / double(totalDat.numberOfReads)) > 0.1
-     ){
-    return true;
+  int nEnds = totalDat.clippedBetween(group.first, group.last, 
+				      group.side != 'b', group.side != 'f', clipped);
+  if(nEnds < minClips){
+    rejected[STAGE_CLUSTER]++;
+    return 0;
   }
+  return nEnds;
+}
 
+// any split, discordant or everted read in the window processPileup()
+// last brought up
 
-  stringstream attributes;
+bool anyEvidence(readPileUp & totalDat){
+  return totalDat.nDiscordant > 0 || totalDat.nsplitRead > 0 || totalDat.evert > 0;
+}
 
-  attributes << "AT="
-	     << double(totalDat.nPaired)           / double(totalDat.numberOfReads)
-             << ","
-	     << double(totalDat.nDiscordant)       / double(totalDat.numberOfReads)
-	     << ","             
-	     << double(totalDat.nMatesMissing)     / double(totalDat.numberOfReads)
-             << ","
-             << double(totalDat.nSameStrand)       / double(totalDat.numberOfReads)
-             << ","
-             << double(totalDat.nCrossChr)         / double(totalDat.numberOfReads)
-             << ","
-             << double(totalDat.nsplitRead)        / double(totalDat.numberOfReads)
-             << "," 
-             << double(totalDat.nf1SameStrand)     / double(totalDat.numberOfReads)
-             << ","
-             << double(totalDat.nf2SameStrand)     / double(totalDat.numberOfReads)
-             << ","
-             << double(totalDat.nf1f2SameStrand)   / double(totalDat.numberOfReads)
-             << ","
-	     << double(totalDat.internalInsertion) / double(totalDat.numberOfReads)
-             << ","
-             << double(totalDat.internalDeletion)  / double(totalDat.numberOfReads);
+// the stages of score() that only count on the pileup, up to the
+// unique clips; false once one rejects the group
 
+bool pileupStages(long int * pos, 
+		  const clipGroup & group, 
+		  readPileUp & totalDat, 
+		  vector<uint32_t> & clipped, 
+		  vector<clippedSequence> & alts, 
+		  string & direction, 
+		  vector<long int> & rejected){
 
+  if(clusterStage(group, totalDat, clipped, 3, rejected) == 0){
+    return false;
+  }
 
+  totalDat.processPileup(pos);
 
-  // finding consensus sequence 
-  vector<string> alts ; // pairBreaks;
+  // stage: any SV evidence in the window
 
-  string direction ;
+  if(! anyEvidence(totalDat)){
+    rejected[STAGE_EVIDENCE]++;
+    return false;
+  }
 
-  uniqClips(pos, totalDat.primary, alts, direction);
+  // stage: mapping quality
 
-  if(alts.size() < 3){
-    return true;
+  if((double(totalDat.nLowMapQ) / double(totalDat.numberOfReads)) == 1){
+    rejected[STAGE_MAPQ]++;
+    return false;
   }
 
-  double nn   = 0;
+  if((double(totalDat.nPaired) / double(totalDat.numberOfReads)) == 1
+     && (double(totalDat.nLowMapQ) / double(totalDat.numberOfReads)) > 0.1
+     ){
+    rejected[STAGE_MAPQ]++;
+    return false;
+  }
 
-  string altSeq = consensus(alts, &nn, direction);
+  // stage: unique clips
 
-  if(altSeq.size() < 10){
-    return true;
-  }
+  uniqClips(group, totalDat, clipped, alts, direction);
 
-  if(nn / double(altSeq.size()) > 0.30 || nn > 18){
-    return true;
+  if(alts.size() < 3){
+    rejected[STAGE_CLIPS]++;
+    return false;
   }
+  return true;
+}
 
-  // searchign for repeats 
-
-  stringstream kfilter;
+// score() runs a group of clipped positions through these stages in
+// turn and stops at the first one that rejects it.  The cheap counts on
+// the pileup go first; the clip consensus and the genotypes are only
+// worked out for the groups that pass everything before them.  pos is
+// the group's mode.
 
-  double nReps  = 0;
-  double nAssay = 0;
+bool score(string seqid, 
+	   long int * pos, 
+	   const clipGroup & group,
+	   readPileUp & totalDat, 
+	   insertDat & localDists, 
+	   string & results, 
+	   const global_opts & localOpts,
+	   const kmerMask & kmerDB,
+	   bool downsampled
+	   ){
 
-  if(altSeq.size() > 17){
-    for(uint16_t l = 0; l < (altSeq.size() - 17); l++){
-      string conKmer = altSeq.substr(l,17);
-      std::size_t found = conKmer.find("N");
-      if (found!=std::string::npos){
-	continue;
-      }
-      nAssay += 1;
-      char * con = new char[18];
-      memcpy(con, conKmer.c_str(), 18);
-      con[17] = '\0';
-      uint64_t front =  charArrayToBin(con, 0);
-      if( binary_search(kmerDB.begin(), kmerDB.end(), front) ){
-	nReps+=1;
-      }
-      delete con;
-    }
-  }
+  vector<long int> & rejected = stageCounts[omp_get_thread_num()];
 
-  double kmHitFrac = double(nReps) / double(nAssay) ; 
+  vector<uint32_t>        clipped;
+  vector<clippedSequence> alts   ;
+  string                  direction;
 
-  if(aminan(kmHitFrac)){
-    kmHitFrac = 0;
+  if(! pileupStages(pos, group, totalDat, clipped, alts, direction, rejected)){
+    return true;
   }
-  kfilter << nAssay << "," << nReps << "," << kmHitFrac ;
 
-  // trying to locate best end
+  // stage: the other end of the breakpoint
 
   string bestSeqid ="" ;
   string bestEnd   ="" ;
@@ -1596,7 +1648,7 @@ bool score(string seqid,
   long int SVLEN              = -1;
 
   // trying to find mate breakpoint using splitread support
-  int otherSeqids = SplitReadEndFinder(pos, totalDat.supplement, bestEnd, bestSeqid, &otherBreakPointCount, &otherBreakPointPos, seqid);
+  int otherSeqids = SplitReadEndFinder(pos, totalDat, bestEnd, bestSeqid, &otherBreakPointCount, &otherBreakPointPos, seqid);
 
   if(!bestEnd.empty()){
     esupport = "sr";
@@ -1605,7 +1657,7 @@ bool score(string seqid,
   // trying to find alternative mappings
 
   if(bestEnd.empty() || seqid.compare(bestSeqid) != 0 ){
-    otherSeqids = otherBreakAlternative(pos, totalDat.primary, bestEnd, bestSeqid, &otherBreakPointCount, &otherBreakPointPos, seqid);
+    otherSeqids = otherBreakAlternative(pos, totalDat, bestEnd, bestSeqid, &otherBreakPointCount, &otherBreakPointPos, seqid);
     if(!bestEnd.empty()){
       esupport = "al";
     }
@@ -1613,7 +1665,7 @@ bool score(string seqid,
 
   // trying to find mate breakpoint using mate mapping postion.
   if(bestEnd.empty() || seqid.compare(bestSeqid) != 0){
-    if(clusterMatePos(seqid, pos, totalDat.primary, bestEnd, &otherBreakPointCount, &otherBreakPointPos)){    
+    if(clusterMatePos(seqid, pos, totalDat, bestEnd, &otherBreakPointCount, &otherBreakPointPos)){    
       bestSeqid = seqid;
       esupport = "mp";
     }
@@ -1623,6 +1675,7 @@ bool score(string seqid,
   // you need at least two reads for a translocation for a split read supported SV
   if(seqid.compare(bestSeqid) != 0 && ! bestSeqid.empty()){
     if(otherBreakPointCount < 2){
+      rejected[STAGE_ENDS]++;
       return true;
     }
   }
@@ -1630,6 +1683,7 @@ bool score(string seqid,
   // SVs over a megabase require additional support 
   if(seqid.compare(bestSeqid) == 0 && ! bestSeqid.empty()){
     if(abs(*pos - otherBreakPointPos) > 1000000 && otherBreakPointCount < 2){
+      rejected[STAGE_ENDS]++;
       return true;
     }
     else{
@@ -1640,20 +1694,43 @@ bool score(string seqid,
   // this eliminates unpaired, which may or maynot be desireable
   
   if(bestEnd.empty()){
+    rejected[STAGE_ENDS]++;
     return true;
   }
 
-  // preparing data structure to load genotypes
-  map < string, indvDat*> ti;
+  // stage: clip consensus
 
-  for(unsigned int t = 0; t < localOpts.all.size(); t++){
-    indvDat * i;
-    i = new indvDat;
-    initIndv(i);
-    ti[localOpts.all[t]] = i;
+  double nn   = 0;
+
+  string altSeq = consensus(alts, &nn, direction);
+
+  if(altSeq.size() < 10){
+    rejected[STAGE_CONSENSUS]++;
+    return true;
+  }
+
+  if(nn / double(altSeq.size()) > 0.30 || nn > 18){
+    rejected[STAGE_CONSENSUS]++;
+    return true;
   }
 
-  loadIndv(ti, totalDat, localOpts, localDists, pos);
+  // stage: genotypes
+
+  vector<indvDat> & ti = genotypeScratch[omp_get_thread_num()];
+
+  ti.resize(localOpts.samples.size());
+
+  for(unsigned int s = 0; s < ti.size(); s++){
+    initIndv(&ti[s]);
+  }
+
+  // the same site draws the same reads whichever thread scores it
+
+  siteRandom & rng = siteRandoms[omp_get_thread_num()];
+
+  rng.seed(localOpts.seed, seqid, *pos);
+
+  loadIndv(ti, totalDat, localOpts, localDists, pos, rng);
 
 
   double nAlt = 0;
@@ -1661,93 +1738,189 @@ bool score(string seqid,
 
   double alternative_relative_depth_sum = 0;
 
-  for(unsigned int t = 0; t < localOpts.all.size(); t++){
-    processGenotype(localOpts.all[t], 
-		    ti[localOpts.all[t]], 
+  glKernel & kernel = glKernels[omp_get_thread_num()];
+
+  kernel.reset(ti.size());
+
+  for(unsigned int s = 0; s < ti.size(); s++){
+    tallyGenotype(s, &ti[s], kernel);
+  }
+
+  vector<double> gls;
+
+  kernel.likelihoods(gls);
+
+  for(unsigned int s = 0; s < ti.size(); s++){
+    processGenotype(s, 
+		    &ti[s], 
+		    &gls[3 * s],
 		    &nAlt, 
 		    &nAltGeno,
 		    &alternative_relative_depth_sum , 
 		    &localDists);
     #ifdef DEBUG
     cerr << "position: " << *pos << endl; 
-    cerr << printIndvDat(ti[localOpts.all[t]]) << endl;
+    cerr << printIndvDat(&ti[s]) << endl;
     #endif 
   }
   
   if(nAlt == 0 ){
-    cleanUp(ti, localOpts);
+    rejected[STAGE_GENOTYPE]++;
     return true;
   }
 
-  attributes << "," 
-	     << double(totalDat.mateTooClose)      / double(totalDat.numberOfReads)
-	     << ","
-	     << double(totalDat.mateTooFar)        / double(totalDat.numberOfReads)
-	     << ","
-	     << double(totalDat.evert)             / double(totalDat.numberOfReads)
-	     << ","
-	     << (alternative_relative_depth_sum/nAltGeno) << ";";
-  
-  info_field * info = new info_field; 
+  int enrichment = 0;
+        
+  for(unsigned int s = 0; s < ti.size(); s++){
+    if(ti[s].nBad > 2){
+      enrichment = 1;
+    }
+  }
 
-  initInfo(info);
+  if(enrichment == 0 ){
+    rejected[STAGE_GENOTYPE]++;
+    return true;
+  }
 
-  loadInfoField(ti, info, localOpts);
+  rejected[STAGE_CALLED]++;
 
-  string infoToPrint = infoText(info);
-  
-  infoToPrint.append(attributes.str());
+  // the rest only annotates the call
 
-  stringstream tmpOutput;
+  // a contig across the breakpoint, when asked for, is screened in
+  // place of the clip consensus when it is longer
 
-  tmpOutput  << seqid           << "\t"  ;       // CHROM
-  tmpOutput  << (*pos) +1       << "\t"  ;       // POS
-  tmpOutput  << "."             << "\t"  ;       // ID
-  tmpOutput  << "N"             << "\t"  ;       // REF
-  tmpOutput  << altSeq          << "\t"  ;       // ALT
-  tmpOutput  << "."             << "\t"  ;       // QUAL
-  tmpOutput  << "."             << "\t"  ;       // FILTER
-  tmpOutput  << infoToPrint                                                          ;
-  tmpOutput  << "KM=" << kfilter.str()                    << ";"                     ;
-  tmpOutput  << "PU=" << totalDat.primary[*pos].size()    << ";"                     ;
-  tmpOutput  << "SU=" << totalDat.supplement[*pos].size() << ";"                     ;
-  tmpOutput  << "CU=" << totalDat.primary.size() + totalDat.supplement.size() << ";" ; 
-  tmpOutput  << "RD=" << totalDat.numberOfReads << ";"                               ;
-  tmpOutput  << "NC=" << alts.size()     << ";"                                      ;
-  tmpOutput  << "MQ=" << double(totalDat.mapQsum) / double(totalDat.numberOfReads)  << ";";
-  tmpOutput  << "MQF=" << double(totalDat.nLowMapQ) / double(totalDat.numberOfReads)  << ";";
+  string contig;
 
-  if(esupport.empty() || bestEnd.empty() || (unsigned int)bestEnd.c_str()[0]  == 0){
-    bestEnd  =  "." ;
-    esupport =  "." ;
+  if(localOpts.assemble){
+    assembleBreakpoint(*pos, totalDat, contig);
   }
-  tmpOutput  << "SP=" << esupport  << ";";
-  tmpOutput  << "BE=" << bestEnd   << ";";
-  tmpOutput  << "DI="   << direction << ";";
-  if(otherBreakPointPos == 0 || SVLEN == -1 ){
-    tmpOutput << "END=.;SVLEN=.\t";
-  }
-  else{
-    tmpOutput << "END=" << otherBreakPointPos << ";" << "SVLEN=" << SVLEN << "\t";
+
+  const string & screened = contig.size() > altSeq.size() ? contig : altSeq;
+
+  // searchign for repeats 
+
+  stringstream kfilter;
+
+  double nReps  = 0;
+  double nAssay = 0;
+
+  // the window ending on the last base has never been assayed
+
+  if(screened.size() > KMER_LEN){
+    vector<uint64_t> kmers(screened.size());
+    uint32_t nKmers = rollingKmers(screened.c_str(), screened.size() - 1, 
+				   KMER_LEN, false, &kmers[0]);
+    for(uint32_t l = 0; l < nKmers; l++){
+      if( kmerDB.contains(kmers[l]) ){
+	nReps += 1;
+      }
+    }
+    nAssay = nKmers;
+  }
+
+  double kmHitFrac = double(nReps) / double(nAssay) ; 
+
+  if(aminan(kmHitFrac)){
+    kmHitFrac = 0;
+  }
+  kfilter << nAssay << "," << nReps << "," << kmHitFrac ;
+
+  stringstream attributes;
+
+  attributes << "AT="
+	     << double(totalDat.nPaired)           / double(totalDat.numberOfReads)
+             << ","
+	     << double(totalDat.nDiscordant)       / double(totalDat.numberOfReads)
+	     << ","             
+	     << double(totalDat.nMatesMissing)     / double(totalDat.numberOfReads)
+             << ","
+             << double(totalDat.nSameStrand)       / double(totalDat.numberOfReads)
+             << ","
+             << double(totalDat.nCrossChr)         / double(totalDat.numberOfReads)
+             << ","
+             << double(totalDat.nsplitRead)        / double(totalDat.numberOfReads)
+             << "," 
+             << double(totalDat.nf1SameStrand)     / double(totalDat.numberOfReads)
+             << ","
+             << double(totalDat.nf2SameStrand)     / double(totalDat.numberOfReads)
+             << ","
+             << double(totalDat.nf1f2SameStrand)   / double(totalDat.numberOfReads)
+             << ","
+	     << double(totalDat.internalInsertion) / double(totalDat.numberOfReads)
+             << ","
+             << double(totalDat.internalDeletion)  / double(totalDat.numberOfReads);
+
+  attributes << "," 
+	     << double(totalDat.mateTooClose)      / double(totalDat.numberOfReads)
+	     << ","
+	     << double(totalDat.mateTooFar)        / double(totalDat.numberOfReads)
+	     << ","
+	     << double(totalDat.evert)             / double(totalDat.numberOfReads)
+	     << ","
+	     << (alternative_relative_depth_sum/nAltGeno) << ";";
+  
+  info_field * info = new info_field; 
+
+  initInfo(info);
+
+  loadInfoField(ti, info, localOpts);
+
+  string infoToPrint = infoText(info);
+  
+  infoToPrint.append(attributes.str());
+
+  stringstream tmpOutput;
+
+  tmpOutput  << seqid           << "\t"  ;       // CHROM
+  tmpOutput  << (*pos) +1       << "\t"  ;       // POS
+  tmpOutput  << "."             << "\t"  ;       // ID
+  tmpOutput  << "N"             << "\t"  ;       // REF
+  tmpOutput  << altSeq          << "\t"  ;       // ALT
+  tmpOutput  << "."             << "\t"  ;       // QUAL
+  tmpOutput  << "."             << "\t"  ;       // FILTER
+  tmpOutput  << infoToPrint                                                          ;
+  tmpOutput  << "KM=" << kfilter.str()                    << ";"                     ;
+  tmpOutput  << "PU=" << totalDat.primary.at(*pos).size()    << ";"                     ;
+  tmpOutput  << "SU=" << totalDat.supplement.at(*pos).size() << ";"                     ;
+  tmpOutput  << "CU=" << totalDat.primary.size() + totalDat.supplement.size() << ";" ; 
+  tmpOutput  << "RD=" << totalDat.numberOfReads << ";"                               ;
+  tmpOutput  << "NC=" << alts.size()     << ";"                                      ;
+  tmpOutput  << "MQ=" << double(totalDat.mapQsum) / double(totalDat.numberOfReads)  << ";";
+  tmpOutput  << "MQF=" << double(totalDat.nLowMapQ) / double(totalDat.numberOfReads)  << ";";
+
+  if(esupport.empty() || bestEnd.empty() || (unsigned int)bestEnd.c_str()[0]  == 0){
+    bestEnd  =  "." ;
+    esupport =  "." ;
+  }
+  tmpOutput  << "SP=" << esupport  << ";";
+  tmpOutput  << "BE=" << bestEnd   << ";";
+  tmpOutput  << "DI="   << direction << ";";
+  if(localOpts.assemble){
+    tmpOutput << "CTG=" << (contig.empty() ? "." : contig) << ";";
+  }
+  if(downsampled){
+    tmpOutput << "DS;";
+  }
+  if(otherBreakPointPos == 0 || SVLEN == -1 ){
+    tmpOutput << "END=.;SVLEN=.\t";
+  }
+  else{
+    tmpOutput << "END=" << otherBreakPointPos << ";" << "SVLEN=" << SVLEN << "\t";
   }
   tmpOutput  << "GT:GL:NR:NA:NS:RD" << "\t" ;
 
-  int enrichment = 0;
-        
   for(unsigned int t = 0; t < localOpts.all.size(); t++){
 
-    if(ti[localOpts.all[t]]->nBad > 2){
-      enrichment = 1;
-    }
+    indvDat & d = ti[localOpts.sampleIds[t]];
 
-    tmpOutput << ti[localOpts.all[t]]->genotype 
-	      << ":" << ti[localOpts.all[t]]->gls[0]
-	      << "," << ti[localOpts.all[t]]->gls[1]
-	      << "," << ti[localOpts.all[t]]->gls[2]
-	      << ":" << ti[localOpts.all[t]]->nGood
-	      << ":" << ti[localOpts.all[t]]->nBad
-	      << ":" << ti[localOpts.all[t]]->nClipping
-	      << ":" << ti[localOpts.all[t]]->nReads    ;
+    tmpOutput << d.genotype 
+	      << ":" << d.gls[0]
+	      << "," << d.gls[1]
+	      << "," << d.gls[2]
+	      << ":" << d.nGood
+	      << ":" << d.nBad
+	      << ":" << d.nClipping
+	      << ":" << d.nReads    ;
     if(t < localOpts.all.size() - 1){
       tmpOutput << "\t";
     }
@@ -1755,25 +1928,25 @@ bool score(string seqid,
   
   tmpOutput << endl;
 
-  if(enrichment == 0 ){
-    cleanUp(ti, localOpts);
-    return true;
-  }
-
   #ifdef DEBUG
   cerr << "line: " << tmpOutput.str();
   #endif 
   
   results.append(tmpOutput.str());
   
-  cleanUp(ti, localOpts);
-  
   delete info;
   
   return true;
 }
 
-bool filter(BamAlignment & al){
+bool clippedEnd(CigarOp & c){
+  return c.Type == 'S' || c.Type == 'H';
+}
+
+// first tier of the read filter: flag, MAPQ and CIGAR are all in the core
+// record, so most reads are settled before their strings are decoded
+
+bool filterCore(BamAlignment & al){
 
   if(!al.IsMapped()){
     return false;
@@ -1786,20 +1959,19 @@ bool filter(BamAlignment & al){
     return false;
   }
 
-  string saTag;
-  if(al.GetTag("SA", saTag)){ 
-  }
-  else{
-    if(al.MapQuality < 21){
-      return false;
-    }
+  vector< CigarOp > & cd = al.CigarData;
+  if(cd.size() > 6){
+    return false;
   }
 
-  vector< CigarOp > cd = al.CigarData;
-  if(cd.size() > 6){
+  // a read without a clip cannot carry an SA tag, so the MAPQ
+  // cutoff can be applied to it right away
+
+  if(! clippedEnd(cd.front()) && ! clippedEnd(cd.back())
+     && al.MapQuality < 21){
     return false;
   }
-  
+
   // soft clipping on both sides. bad party
 
   if(cd.front().Type   == 'S' 
@@ -1809,220 +1981,1103 @@ bool filter(BamAlignment & al){
      ){
     return false;
   }
+  return true;
+}
 
-  string xaTag;
-  
-  if(al.GetTag("XA", xaTag)){
-    vector<string> xas = split(xaTag, ";");
-      if(xas.size() > 2){
-	#ifdef DEBUG
-	cerr << "failed xa filter" << al.Name << " " << xaTag << endl;
-	#endif
+// reads that enter the pileup as clipped, split or discordant need their
+// name, bases and tags; so do reads whose mate may share the pileup,
+// since the mate can flag them as odd by name
+
+bool needsCharData(BamAlignment & al){
+
+  vector< CigarOp > & cd = al.CigarData;
+
+  if(clippedEnd(cd.front()) || clippedEnd(cd.back())){
+    return true;
+  }
+  if((al.AlignmentFlag & 0x0800) != 0){
+    return true;
+  }
+  if(!al.IsProperPair() || !al.IsMateMapped() || al.RefID != al.MateRefID){
+    return true;
+  }
+  if(al.IsReverseStrand() == al.IsMateReverseStrand()){
+    return true;
+  }
+
+  long int span = al.GetEndPosition(false,true) - al.Position;
+
+  if(labs(long(al.MatePosition) - long(al.Position)) <= 2 * span){
+    return true;
+  }
+
+  for(vector< CigarOp >::iterator cig = cd.begin(); 
+      cig != cd.end(); cig++){
+    if(((*cig).Type == 'I' || (*cig).Type == 'D') && (*cig).Length > 25){
+      return true;
+    }
+  }
+  return false;
+}
+
+// second tier of the read filter: tag and sequence checks, only run on
+// reads that were decoded
+
+bool filterCharData(BamAlignment & al, alignmentTags & tags){
+
+  if(tags.sa.empty() && al.MapQuality < 21){
+    return false;
+  }
+
+  if(tags.nXa > 1){
+    #ifdef DEBUG
+    cerr << "failed xa filter" << al.Name << " " << tags.xa << endl;
+    #endif
 	
-	return false;
+    return false;
+  }
+
+  if(checkN(al.QueryBases)){
+    return false;
+  }
+  return true;
+}
+
+// filters a core read and decodes its strings when the pileup needs them
+
+bool filterRead(BamAlignment & al, alignmentTags & tags){
+
+  if(! filterCore(al)){
+    return false;
+  }
+  if(needsCharData(al)){
+    al.BuildCharData();
+    tags.load(al);
+    if(! filterCharData(al, tags)){
+      return false;
+    }
+  }
+  else{
+    tags.clear();
+  }
+  return true;
+}
+
+bool filter(BamAlignment & al, bamPool * pool, int sample, alignmentTags & tags){
+
+  if(! filterRead(al, tags)){
+    return false;
+  }
+  al.Filename = pool->filename(sample);
+  return true;
+}
+ 
+// the read group of a read from the bam at index sample of all.  The
+// group only matters for the insert cutoffs, so a read that was not
+// decoded for the pileup is only decoded here when the cutoffs of its
+// sample's groups disagree about its insert; otherwise any group gives
+// the same answer and it takes the first.
+
+int readGroupOf(BamAlignment & al, int sample){
+
+  int s = globalOpts.sampleIds[sample];
+
+  if(! readGroups.multiple(s)){
+    return readGroups.first(s);
+  }
+
+  // reads that skip decoding all have a mate on the same reference
+
+  if(! needsCharData(al)){
+    double ilength = abs(double(al.InsertSize));
+    int    first   = readGroups.first(s);
+    int    odd     = -2;
+    bool   agree   = true;
+    for(int g = first; g < first + readGroups.count(s); g++){
+      int side = ilength < insertDists.lowCut[g]  ? -1 
+	:        ilength > insertDists.highCut[g] ?  1 : 0;
+      if(odd != -2 && side != odd){
+	agree = false;
+	break;
       }
+      odd = side;
+    }
+    if(agree){
+      return first;
+    }
+  }
+
+  al.BuildCharData();
+
+  string rg;
+  if(! al.GetTag("RG", rg)){
+    rg.clear();
+  }
+  return readGroups.group(s, rg);
+}
+
+// clipped positions are keyed as the position times two, plus one for
+// a back clip, so the keys sort by position
+
+inline long int clipKey(long int pos, bool back){
+  return pos * 2 + (back ? 1 : 0);
+}
+
+// groups the clips from the front of the frontier up to window bp past
+// it, each side of the breakpoint on its own, in the order of
+// their modes.  The two sides of an insertion are a base apart and are
+// kept apart; when both sides share a mode they are one group, as a
+// single position always was.  A span stays on one side of start and
+// before end, so the regions on either side never share one.
+
+void nextClipGroups(clipFrontier & frontier, 
+		    long int window, 
+		    long int start, 
+		    long int end, 
+		    long int * spanLast,
+		    vector<clipGroup> & groups){
+
+  long int first = frontier.front() / 2;
+  long int limit = first + window;
+
+  if(first < start && limit >= start){
+    limit = start - 1;
+  }
+  if(first < end && limit >= end){
+    limit = end - 1;
+  }
+
+  clipGroup sides[2];  // front, back
+
+  uint32_t best[2] = {0, 0};
+
+  for(int b = 0; b < 2; b++){
+    sides[b].first    = -1;
+    sides[b].last     = -1;
+    sides[b].mode     = -1;
+    sides[b].nClipped = 0;
+    sides[b].side     = b ? 'b' : 'f';
+    sides[b].evidence = false;
+  }
+
+  *spanLast = first;
+
+  long int lastKey = min(clipKey(limit, true), frontier.back());
+
+  for(long int key = frontier.front(); key <= lastKey; key++){
+
+    uint32_t n = frontier.count(key);
+
+    if(n == 0){
+      continue;
+    }
+
+    long int    pos = key / 2;
+    int         b   = key % 2;
+    clipGroup & g   = sides[b];
+
+    if(g.nClipped == 0){
+      g.first = pos;
+    }
+    if(n > best[b]){
+      best[b] = n;
+      g.mode  = pos;
+    }
+    g.last      = pos;
+    g.nClipped += n;
+    *spanLast   = pos;
+  }
+
+  groups.clear();
+
+  if(sides[0].nClipped > 0 && sides[1].nClipped > 0
+     && sides[0].mode == sides[1].mode){
+    clipGroup both = sides[0];
+    both.last      = max(sides[0].last, sides[1].last);
+    both.first     = min(sides[0].first, sides[1].first);
+    both.nClipped += sides[1].nClipped;
+    both.side      = 0;
+    groups.push_back(both);
+    return;
+  }
+
+  for(int b = 0; b < 2; b++){
+    if(sides[b].nClipped > 0){
+      groups.push_back(sides[b]);
+    }
+  }
+  if(groups.size() == 2 && groups[1].mode < groups[0].mode){
+    swap(groups[0], groups[1]);
+  }
+}
+
+// hands the text to the ordered writer, or writes it straight out when
+// a single region is run
+
+void writeResults(string & results){
+  if(writer != NULL){
+    writer->add(omp_get_thread_num(), results);
+  }
+  else{
+    omp_set_lock(&lock);
+    cout << results;
+    omp_unset_lock(&lock);
+  }
+  results.clear();
+}
+
+// scores the region on the reads of every bam; or, given the index of
+// one bam in all and somewhere to put them, reads that bam alone and
+// keeps the clip groups that pass the cluster stages, with their
+// clipped ends, for --two-phase discovery
+
+bool runRegion(int seqidIndex, 
+	       int start, 
+	       int end, 
+	       const vector< RefData > & seqNames, 
+	       const kmerMask & kmerDB,
+	       int only = -1,
+	       vector<clipGroup> * candidates = NULL){
+  
+  string regionResults;
+
+  const global_opts & localOpts = globalOpts;
+
+  omp_set_lock(&lock);
+
+  insertDat localDists  = insertDists;
+
+  omp_unset_lock(&lock);
+
+  bamPool * All = readerPools[omp_get_thread_num()];
+
+  vector<string> files = localOpts.readFrom;
+
+  // the evidence files --two-phase genotypes from are only held open
+  // while a region is read in, so the threads do not each keep one
+  // open per bam
+
+  bool keepOpen = only >= 0 || ! localOpts.twoPhase;
+
+  if(only >= 0){
+    All   = samplePools[omp_get_thread_num()];
+    files = vector<string>(1, localOpts.all[only]);
+    if(All->isOpen() && All->filename(0) != files[0]){
+      All->close();
+    }
+  }
+
+  if(! All->isOpen()){
+    if(! All->open(files, keepOpen)){
+      cerr << "FATAL: unable to open BAMs or indices after: 500 attempts"  << endl;
+      cerr << "Bamtools error message:\n" <<  All->errorString()  << endl;
+      cerr << "INFO : try using less CPUs in the -x option" << endl;
+      exit(1);
+    }
+  }
+
+  if(!All->setRegion(seqidIndex, start, end)){
+    return false;
+  }
+
+  double scanStart = bamPool::wallTime();
+
+  BamAlignment al     ;
+  alignmentTags tags  ;
+  readPileUp allPileUp;
+  bool hasNextAlignment = true;
+  int  file             = 0;
+  int  sample           = 0;  // in all
+
+  clipFrontier clipped;
+  long int currentPos  = -1;
+
+  depthSampler depth(localOpts.maxDepth);
+
+  // discovery keeps its own tally; the stage report is of the calls
+
+  vector<long int> discoveryRejected(N_SCORE_STAGES, 0);
+
+  // the groups to score next and the clipped positions they span
+
+  vector<clipGroup> groups;
+  long int spanFirst = -1;
+  long int spanLast  = -1;
+  
+  // clipped positions still queued when the reads run out are scored
+  // too, so the end of a region is not left short
+
+  while(hasNextAlignment || ! clipped.empty()){    
+
+    clipped.popThrough(clipKey(spanLast, true));
+
+    while(hasNextAlignment && clipped.empty()){
+      hasNextAlignment = All->getNextAlignmentCore(al, &file);
+      if(!hasNextAlignment){
+	break;
+      }
+      if(!filter(al, All, file, tags)){
+	continue;
+      }
+      sample = only >= 0 ? only : file;
+      vector< CigarOp > cd = al.CigarData;
+      if(cd.front().Type == 'S'
+	 && cd.back().Type  == 'S'
+	 && cd.front().Length > 10
+	 && cd.back().Length  > 10
+	 ){
+	continue;
+      }
+      if(! depth.keep(al, All->nameHash())){
+	continue;
+      }
+
+      if(cd.front().Type == 'S'){
+	clipped.add(clipKey(al.Position, false));
+      }
+      if(cd.back().Type  == 'S'){
+	clipped.add(clipKey(al.GetEndPosition(false,true), true));
+      }
+      allPileUp.processAlignment(al, sample, readGroupOf(al, sample), tags);
+    }
+    
+    // reads starting up to a window past the front, so the frontier
+    // holds every clipped position the next group can take in
+    
+    while(hasNextAlignment 
+	  && ! clipped.empty() 
+	  && al.Position <= clipped.front() / 2 + localOpts.clipWindow){
+      hasNextAlignment = All->getNextAlignmentCore(al, &file);
+      if(!hasNextAlignment){
+        break;
+      }
+      if(!filter(al, All, file, tags)){
+        continue;
+      }
+      sample = only >= 0 ? only : file;
+      if(! depth.keep(al, All->nameHash())){
+        continue;
+      }
+      vector< CigarOp > cd = al.CigarData;
+      if(cd.front().Type == 'S'){
+        clipped.add(clipKey(al.Position, false));
+      }
+      if(cd.back().Type  == 'S'){
+        clipped.add(clipKey(al.GetEndPosition(false,true), true));
+      }
+      allPileUp.processAlignment(al, sample, readGroupOf(al, sample), tags);
+    }
+    
+    // reads clipped anywhere in the span stay queued until it is scored
+
+    allPileUp.purgePast( &spanFirst );    
+    depth.purgeBefore(spanFirst);
+
+    bool finished = false;
+
+    for(vector<clipGroup>::iterator g = groups.begin(); g != groups.end(); g++){
+
+      currentPos = (*g).mode;
+
+      #ifdef DEBUG
+      cerr << "About to score : " << currentPos << endl;
+      #endif
+
+      // the region owns the positions in [start, end); the pileup at
+      // any of them holds every read overlapping it, so calls do not
+      // depend on where the genome was cut.  A split can pull in the
+      // end.
+
+      if(currentPos >= end){
+	finished = true;
+	break;
+      }
+      if(scheduler != NULL 
+	 && ! scheduler->keepGoing(omp_get_thread_num(), currentPos)){
+	finished = true;
+	break;
+      }
+
+      if(currentPos < start){
+	continue;
+      }
+
+      if(candidates != NULL){
+	vector<uint32_t> clips;
+	int nEnds = clusterStage(*g, allPileUp, clips, 
+				 DISCOVERY_MIN_CLIPS, discoveryRejected);
+	if(nEnds > 0){
+	  allPileUp.processPileup(&currentPos);
+	  candidates->push_back(*g);
+	  candidates->back().nClipped = nEnds;
+	  candidates->back().evidence = anyEvidence(allPileUp);
+	}
+	continue;
+      }
+
+      if(! score(seqNames[seqidIndex].RefName, 
+		    &currentPos, 
+		    *g,
+		    allPileUp,
+		    localDists, 
+		    regionResults, 
+		    localOpts,
+		    kmerDB,
+		    depth.downsampled(currentPos))){
+	cerr << "FATAL: problem during scoring" << endl;
+	cerr << "FATAL: wham exiting"           << endl;
+	exit(1);
+      }
+    }
+
+    if(finished || clipped.empty()){
+      break;
+    }
+
+    // a split may have pulled the end into the span; the scheduler is
+    // told how far the span reaches so no later split lands in it
+
+    long int spanEnd = end;
+
+    spanFirst = clipped.front() / 2;
+
+    while(true){
+      nextClipGroups(clipped, localOpts.clipWindow, start, spanEnd, 
+		     &spanLast, groups);
+      if(scheduler == NULL
+	 || spanLast == spanFirst
+	 || scheduler->keepGoing(omp_get_thread_num(), spanLast)){
+	break;
+      }
+      spanEnd = spanLast;
+    }
+
+    if(regionResults.size() > 100000){
+      writeResults(regionResults);
+    }
+  }
+
+  writeResults(regionResults);
+  
+  All->scanSeconds += bamPool::wallTime() - scanStart;
+
+  if(candidates == NULL){
+    readsDownsampled[omp_get_thread_num()] += depth.nDropped;
+  }
+
+  return true;
+}
+
+// reports how the reader pools spent their time, then closes them
+
+void closeReaderPools(void){
+
+  long   nOpened  = 0;
+  long   nRegions = 0;
+  double openS    = 0;
+  double seekS    = 0;
+  double scanS    = 0;
+
+  for(vector<bamPool *>::iterator it = readerPools.begin();
+      it != readerPools.end(); it++){
+    nOpened  += (*it)->nOpened    ;
+    nRegions += (*it)->nRegions   ;
+    openS    += (*it)->openSeconds;
+    seekS    += (*it)->seekSeconds;
+    scanS    += (*it)->scanSeconds;
+    delete (*it);
+  }
+  readerPools.clear();
+
+  for(vector<microAssembler *>::iterator it = assemblers.begin();
+      it != assemblers.end(); it++){
+    delete (*it);
+  }
+  assemblers.clear();
+
+  vector<long int> stages(N_SCORE_STAGES, 0);
+  long int         nScored = 0;
+
+  for(vector< vector<long int> >::iterator it = stageCounts.begin();
+      it != stageCounts.end(); it++){
+    for(int s = 0; s < N_SCORE_STAGES; s++){
+      stages[s] += (*it)[s];
+      nScored   += (*it)[s];
+    }
+  }
+  stageCounts.clear();
+
+  cerr << "INFO: positions scored: " << nScored << endl;
+  for(int s = 0; s < N_SCORE_STAGES - 1; s++){
+    cerr << "INFO: rejected at " << scoreStageNames[s] << ": " << stages[s] << endl;
+  }
+  cerr << "INFO: " << scoreStageNames[STAGE_CALLED] << ": " << stages[STAGE_CALLED] << endl;
+
+  if(globalOpts.maxDepth > 0){
+    long int nDropped = 0;
+    for(vector<long int>::iterator it = readsDownsampled.begin();
+	it != readsDownsampled.end(); it++){
+      nDropped += (*it);
+    }
+    cerr << "INFO: reads left out past --max-depth: " << nDropped << endl;
+  }
+
+  cerr << "INFO: reader pools opened " << nOpened << " BAM files for " << nRegions << " regions" << endl;
+  cerr << "INFO: seconds opening BAMs and indices: " << openS 
+       << ", seeking to regions: " << seekS 
+       << ", reading and scoring: " << scanS << endl;
+}
+
+bool loadBed(vector<regionDat*> & features, RefVector seqs){
+
+  map<string, int> seqidToInt;
+
+  int index = 0;
+
+  for(vector< RefData >::iterator sit = seqs.begin(); sit != seqs.end(); sit++){
+
+    seqidToInt[ (*sit).RefName ] = index;
+
+    index+=1;
+  }
+
+  ifstream featureFile (globalOpts.bed);
+
+  string line;
+
+  if(featureFile.is_open()){
+
+    while(getline(featureFile, line)){
+
+      vector<string> region = split(line, "\t");
+
+      int start = atoi(region[1].c_str()) ;
+      int end   = atoi(region[2].c_str()) ;
+  
+      regionDat * r = new regionDat;
+      r->seqidIndex = seqidToInt[region[0]];
+      r->start      = start;
+      r->end        = end  ;
+      features.push_back(r);
+    }
+  }
+  else{
+    return false;
+  }
+
+  featureFile.close();
+  
+  return true;
+}
+
+// compressed bytes per 16 kb window of each reference, summed over the
+// BAM indices and evidence files; all zero when no index could be read
+
+int indexWeights(RefVector & sequences, vector< vector<double> > & windows){
+
+  windows.clear();
+  windows.resize(sequences.size());
+
+  int nIndexed = 0;
+
+  for(vector<string>::iterator it = globalOpts.all.begin(); 
+      it != globalOpts.all.end(); it++){
+    evidenceReader evidence;
+    if(evidenceReader::isEvidence(*it) && evidence.open(*it)){
+      nIndexed += 1;
+      for(unsigned int r = 0; r < sequences.size(); r++){
+	evidence.addWindowBytes(r, windows[r]);
+      }
+      continue;
+    }
+    baiIndex bai;
+    if(! bai.load(*it)){
+      continue;
+    }
+    nIndexed += 1;
+    for(unsigned int r = 0; r < sequences.size(); r++){
+      bai.addWindowBytes(r, windows[r]);
+    }
+  }
+  return nIndexed;
+}
+
+// the weight of [start, end) on a reference, taking partial windows
+// in proportion
+
+double regionWeight(vector<double> & w, long int start, long int end){
+
+  double sum = 0;
+
+  while(start < end){
+    long int window = start / BAI_WINDOW;
+    long int stop   = min(end, (window + 1) * BAI_WINDOW);
+    double   bytes  = (window < (long int) w.size()) ? w[window] : 0;
+    sum  += bytes * double(stop - start) / double(BAI_WINDOW);
+    start = stop;
+  }
+  return sum;
+}
+
+// cuts every reference into regions holding about as much data as 1 Mb
+// at the typical (median) depth, and never longer than 1 Mb; deep
+// stretches get short regions.  Without index data every window weighs
+// the same and the regions come out at about 1 Mb.
+
+void depthChunks(RefVector & sequences, 
+		 vector< vector<double> > & windows, 
+		 vector<regionTask> & tasks){
+
+  vector<double> nonzero;
+
+  for(unsigned int r = 0; r < windows.size(); r++){
+    for(unsigned int i = 0; i < windows[r].size(); i++){
+      if(windows[r][i] > 0){
+	nonzero.push_back(windows[r][i]);
+      }
+    }
+  }
+
+  bool uniform = nonzero.empty();
+
+  double typical = 1;
+
+  if(! uniform){
+    nth_element(nonzero.begin(), nonzero.begin() + nonzero.size() / 2, nonzero.end());
+    typical = nonzero[nonzero.size() / 2];
+  }
+
+  double target = typical * 1000000.0 / double(BAI_WINDOW);
+
+  for(unsigned int r = 0; r < sequences.size(); r++){
+
+    long int length = sequences[r].RefLength;
+
+    if(length < 2000){
+      cerr << "WARNING: " << sequences[r].RefName << " is too short for WHAM-BAM: " << length << endl;
+      continue;
+    }
+
+    vector<double> flat;
+    if(uniform){
+      flat.assign(length / BAI_WINDOW + 1, 1);
+    }
+    vector<double> & w = uniform ? flat : windows[r];
+
+    long int start = 500;
+
+    while(start < length){
+
+      long int end    = start;
+      double   weight = 0;
+
+      // a window that would overfill the region starts the next one, so
+      // a deep window ends up in a region of its own
+
+      while(end < length && end - start < 1000000){
+	long int stop  = min(length, (end / BAI_WINDOW + 1) * BAI_WINDOW);
+	stop           = min(stop, start + 1000000);
+	double   piece = regionWeight(w, end, stop);
+	if(end > start && weight + piece > target){
+	  break;
+	}
+	weight += piece;
+	end     = stop;
+      }
+
+      regionTask task;
+      task.seqidIndex = r;
+      task.start      = start;
+      task.end        = end;
+      task.weight     = weight;
+      tasks.push_back(task);
+
+      start = end;
+    }
+  }
+}
+
+bool genomicOrder(const regionTask & a, const regionTask & b){
+  if(a.seqidIndex != b.seqidIndex){
+    return a.seqidIndex < b.seqidIndex;
+  }
+  return a.start < b.start;
+}
+
+// phase one of --two-phase: each bam is read alone over every region,
+// keeping the groups of clipped reads that pass the cluster stage with
+// as little as DISCOVERY_MIN_CLIPS clipped end, and noting whether the
+// bam has split or discordant reads at the group.  Both are only
+// pooled over the bams when the windows are built, so a site whose
+// clipped reads and evidence are spread thinly over many bams is still
+// found.  The pairs of bam and region are handed out bam by bam, so a
+// thread mostly stays on one file and holds only that one open.
+
+void discoverCandidates(vector<regionTask> & tasks,
+			RefVector & sequences,
+			const kmerMask & kmerDB,
+			vector< vector<clipGroup> > & candidates){
+
+  candidates.assign(tasks.size(), vector<clipGroup>());
+
+  // a bam listed twice is read once
+
+  vector<int> firstFile(globalOpts.samples.size(), -1);
+
+  for(unsigned int f = 0; f < globalOpts.all.size(); f++){
+    if(firstFile[globalOpts.sampleIds[f]] < 0){
+      firstFile[globalOpts.sampleIds[f]] = f;
+    }
+  }
+
+  long int nTasks = tasks.size();
+  long int nPairs = long(firstFile.size()) * nTasks;
+
+  vector< vector< pair<long int, clipGroup> > > found(omp_get_max_threads());
+
+  double start = bamPool::wallTime();
+
+ #pragma omp parallel for schedule(dynamic)
+  for(long int i = 0; i < nPairs; i++){
+
+    int          s    = i / nTasks;
+    regionTask & task = tasks[i % nTasks];
+
+    vector<clipGroup> groups;
+
+    if(! runRegion(task.seqidIndex, task.start, task.end, sequences, kmerDB,
+		   firstFile[s], &groups)){
+      omp_set_lock(&lock);
+      cerr << "WARNING: discovery failed in " << globalOpts.samples[s] << ": "
+	   << sequences[task.seqidIndex].RefName 
+	   << ":"  << task.start << "-" << task.end << endl;
+      omp_unset_lock(&lock);
+    }
+    for(vector<clipGroup>::iterator it = groups.begin(); it != groups.end(); it++){
+      found[omp_get_thread_num()].push_back(make_pair(i % nTasks, *it));
+    }
+  }
+
+  long int nFound = 0;
+
+  for(unsigned int t = 0; t < found.size(); t++){
+    for(vector< pair<long int, clipGroup> >::iterator it = found[t].begin();
+	it != found[t].end(); it++){
+      candidates[it->first].push_back(it->second);
+    }
+    nFound += found[t].size();
   }
 
-  if(checkN(al.QueryBases)){
-    return false;
+  for(vector<bamPool *>::iterator it = samplePools.begin(); 
+      it != samplePools.end(); it++){
+    (*it)->close();
   }
-  return true;
+
+  cerr << "INFO: discovery found " << nFound << " clip groups in " 
+       << firstFile.size() << " bams in "
+       << bamPool::wallTime() - start << " seconds" << endl;
 }
- 
-bool runRegion(int seqidIndex, 
-	       int start, 
-	       int end, 
-	       vector< RefData > seqNames, 
-	       vector<uint64_t> kmerDB){
-  
-  string regionResults;
 
-  omp_set_lock(&lock);
+bool firstClipped(const clipGroup & a, const clipGroup & b){
+  return a.first < b.first;
+}
 
-  global_opts localOpts = globalOpts;
-  insertDat localDists  = insertDists;
+// phase two of --two-phase: the groups the bams found are chained
+// where they lie within the clip window of each other, and a chain
+// whose clipped ends add up to the three a call needs, and that has
+// evidence in any of its bams, becomes a site, as the pooled reads
+// would pass the cluster size and evidence stages.
+// Each site is scored from CANDIDATE_PAD bp before it, so the reads and
+// clips leading up to it are in the pileup as in a full scan.  Sites
+// closer than that share a window, and windows stay inside the region
+// their sites came from.
 
-  omp_unset_lock(&lock);
+void candidateWindows(vector<regionTask> & tasks,
+		      vector< vector<clipGroup> > & candidates,
+		      vector<regionTask> & windows){
 
-  BamMultiReader All;
-  
-  prepBams(All, "all");
+  windows.clear();
 
-  if(!All.SetRegion(seqidIndex, start, seqidIndex, end)){
-    return false;
-  }
+  long int nSites = 0;
 
+  for(unsigned int i = 0; i < tasks.size(); i++){
 
-  BamAlignment al     ;
-  readPileUp allPileUp;
-  bool hasNextAlignment = true;
+    regionTask & task  = tasks[i];
+    unsigned int first = windows.size();
 
-  hasNextAlignment = All.GetNextAlignment(al);
-  if(!hasNextAlignment){
-    All.Close();
-    return false;
-  }
+    double perBase = (task.end > task.start) 
+      ? task.weight / double(task.end - task.start) : 0;
 
-  list <long int> clippedBuffer;
-  long int currentPos  = -1;
-  
-  while(hasNextAlignment){    
-    while(currentPos >= clippedBuffer.front()){
-      if(clippedBuffer.empty()){
-	break;
-      }
-      clippedBuffer.pop_front();
-    }
-    while(clippedBuffer.empty()){
-      hasNextAlignment = All.GetNextAlignment(al);
-      if(!hasNextAlignment){
-	break;
+    vector<clipGroup> & groups = candidates[i];
+
+    sort(groups.begin(), groups.end(), firstClipped);
+
+    for(unsigned int g = 0; g < groups.size(); ){
+
+      long int chainFirst = groups[g].first;
+      long int chainLast  = groups[g].last;
+      long int nEnds      = 0;
+      bool     evidence   = false;
+
+      for(; g < groups.size() 
+	    && groups[g].first <= chainLast + globalOpts.clipWindow; g++){
+	chainLast  = max(chainLast, groups[g].last);
+	nEnds     += groups[g].nClipped;
+	evidence   = evidence || groups[g].evidence;
       }
-      if(!filter(al)){
+
+      if(nEnds < 3 || ! evidence){
 	continue;
       }
-      vector< CigarOp > cd = al.CigarData;
-      if(cd.front().Type == 'S'
-	 && cd.back().Type  == 'S'
-	 && cd.front().Length > 10
-	 && cd.back().Length  > 10
-	 ){
+
+      nSites += 1;
+
+      long int start = max(long(task.start), chainFirst - CANDIDATE_PAD);
+      long int end   = min(long(task.end),   chainLast + 1);
+
+      if(windows.size() > first && start <= windows.back().end){
+	windows.back().end = max(long(windows.back().end), end);
 	continue;
       }
 
-      if(cd.front().Type == 'S'){
-	clippedBuffer.push_back(al.Position);
-      }
-      if(cd.back().Type  == 'S'){
-	clippedBuffer.push_back(al.GetEndPosition(false,true));
-      }
-      allPileUp.processAlignment(al);
+      regionTask window = task;
+      window.start      = start;
+      window.end        = end;
+      windows.push_back(window);
     }
-    
-    clippedBuffer.sort();
-    
-    while(al.Position <= clippedBuffer.front()){
-      hasNextAlignment = All.GetNextAlignment(al);
-      if(!hasNextAlignment){
-        break;
-      }
-      if(!filter(al)){
-        continue;
-      }
-      vector< CigarOp > cd = al.CigarData;
-      if(cd.front().Type == 'S'){
-        clippedBuffer.push_back(al.Position);
-      }
-      if(cd.back().Type  == 'S'){
-        clippedBuffer.push_back(al.GetEndPosition(false,true));
-      }
-      allPileUp.processAlignment(al);
+
+    for(unsigned int w = first; w < windows.size(); w++){
+      windows[w].weight = perBase * double(windows[w].end - windows[w].start);
     }
-    
-    clippedBuffer.sort();
+  }
 
-    #ifdef DEBUG
-    cerr << "About to score : " << currentPos << endl;
-    #endif
+  cerr << "INFO: the bams together have " << nSites << " candidate sites" << endl;
+}
 
-    allPileUp.purgePast( &currentPos );    
-
-    if(! score(seqNames[seqidIndex].RefName, 
-	       &currentPos, 
-	       allPileUp,
-	       localDists, 
-	       regionResults, 
-	       localOpts,
-	       kmerDB)){
-      cerr << "FATAL: problem during scoring" << endl;
-      cerr << "FATAL: wham exiting"           << endl;
-      exit(1);
-    }
+// writes a read that passed filterRead to an evidence file.  Every
+// kept read carries its group among those of its bam, which is sample
+// in groups, and its name or, when the pileup does not decode it, the
+// name's hash for the depth cap.  nameHash is the hash of a read that
+// came from an evidence file without its name.
 
-    currentPos = clippedBuffer.front();
+bool addEvidence(evidenceWriter & writer, 
+		 BamAlignment & al, 
+		 const readGroupIndex & groups, 
+		 int sample,
+		 alignmentTags & tags,
+		 const uint64_t * nameHash = NULL){
 
-    if(regionResults.size() > 100000){
-      omp_set_lock(&lock);
-      cout << regionResults;
-      omp_unset_lock(&lock);
-      regionResults.clear(); 
+  bool informative = needsCharData(al);
+
+  al.BuildCharData();
+
+  int g = 0;
+  if(groups.multiple(sample)){
+    string rg;
+    if(! al.GetTag("RG", rg)){
+      rg.clear();
     }
+    g = groups.group(sample, rg) - groups.first(sample);
   }
 
-  omp_set_lock(&lock);
+  return writer.add(al, g, informative, tags, nameHash);
+}
 
-  cout << regionResults;
+// the rest of phase two: each bam is read once, alone, over all the
+// windows, and the reads it has in them go to an evidence file in a
+// scratch directory.  The windows are then scored from those files,
+// which hold the reads near the sites and nothing else, so the bams
+// are never all open at once.  globalOpts.readFrom is pointed at them.
 
-  omp_unset_lock(&lock);
-  
-  regionResults.clear();
-  
-  All.Close();
+void gatherWindows(vector<regionTask> & windows, 
+		   RefVector & sequences, 
+		   string & scratch){
 
-  return true;
-}
+  const char * tmp = getenv("TMPDIR");
 
-bool loadKmerDB(vector<uint64_t> & DB){
+  string templ = string(tmp != NULL && tmp[0] != 0 ? tmp : "/tmp") + "/wham.XXXXXX";
 
-  ifstream kmerDB (globalOpts.mask);
-  string line;
+  vector<char> dir(templ.begin(), templ.end());
+  dir.push_back(0);
+
+  if(mkdtemp(&dir[0]) == NULL){
+    cerr << "FATAL: cannot make a scratch directory like: " << templ << endl;
+    exit(1);
+  }
+  scratch = &dir[0];
+
+  vector<string> gathered(globalOpts.samples.size());
+
+  long int nReads = 0;
+  double   start  = bamPool::wallTime();
+
+ #pragma omp parallel for schedule(dynamic)
+  for(unsigned int s = 0; s < globalOpts.samples.size(); s++){
+
+    stringstream name;
+    name << scratch << "/" << s << ".wev";
+
+    gathered[s] = name.str();
+
+    vector<string> file(1, globalOpts.samples[s]);
+
+    bamPool * pool = samplePools[omp_get_thread_num()];
+
+    string    headerText;
+    RefVector refs;
+
+    if(! readHeader(globalOpts.samples[s], headerText, refs) || ! pool->open(file)){
+      cerr << "FATAL: cannot read - or find index for: " << globalOpts.samples[s] << endl;
+      exit(1);
+    }
+
+    evidenceWriter writer;
+    if(! writer.open(gathered[s], headerText, refs, sampleStats[s])){
+      cerr << "FATAL: cannot write: " << gathered[s] << endl;
+      exit(1);
+    }
+
+    BamAlignment  al  ;
+    alignmentTags tags;
+    int           f   ;
+    int           ref  = -1;
+    long int      past = -1;  // the last position read for the window before
+
+    for(vector<regionTask>::iterator w = windows.begin(); w != windows.end(); w++){
+
+      if(! pool->setRegion((*w).seqidIndex, (*w).start, (*w).end)){
+	continue;
+      }
+      while(pool->getNextAlignmentCore(al, &f)){
+
+	// reads that reach back into the window before were kept with it
 
-  uint64_t kmer;
+	if(al.RefID == ref && al.Position <= past){
+	  continue;
+	}
+	if(! filterRead(al, tags)){
+	  continue;
+	}
+	if(! addEvidence(writer, al, readGroups, s, tags, pool->nameHash())){
+	  cerr << "FATAL: " << globalOpts.samples[s] << " is not sorted, or " 
+	       << gathered[s] << " could not be written" << endl;
+	  exit(1);
+	}
+      }
+      ref  = (*w).seqidIndex;
+      past = (*w).end;
+    }
 
-  if(kmerDB.is_open()){
-    while(getline(kmerDB, line)){
-      kmer = std::stoul(line);
-      DB.push_back(kmer);
+    if(! writer.close()){
+      cerr << "FATAL: cannot write: " << gathered[s] << endl;
+      exit(1);
     }
+    pool->close();
+
+    omp_set_lock(&lock);
+    nReads += writer.nReads;
+    omp_unset_lock(&lock);
   }
-  else{
-    return false;
+
+  for(unsigned int f = 0; f < globalOpts.all.size(); f++){
+    globalOpts.readFrom[f] = gathered[globalOpts.sampleIds[f]];
   }
 
-  kmerDB.close();
-  return true;
+  cerr << "INFO: gathered " << nReads << " reads in the windows from " 
+       << gathered.size() << " bams into " << scratch << " in " 
+       << bamPool::wallTime() - start << " seconds" << endl;
 }
 
-bool loadBed(vector<regionDat*> & features, RefVector seqs){
+// removes what gatherWindows wrote
 
-  map<string, int> seqidToInt;
+void removeGathered(const string & scratch){
+  for(unsigned int f = 0; f < globalOpts.readFrom.size(); f++){
+    if(globalOpts.readFrom[f] != globalOpts.all[f]){
+      unlink(globalOpts.readFrom[f].c_str());
+      globalOpts.readFrom[f] = globalOpts.all[f];
+    }
+  }
+  rmdir(scratch.c_str());
+}
 
-  int index = 0;
+void closeScheduler(void){
+  if(scheduler == NULL){
+    return;
+  }
+  scheduler->report();
+  delete scheduler;
+  scheduler = NULL;
+}
 
-  for(vector< RefData >::iterator sit = seqs.begin(); sit != seqs.end(); sit++){
+// WHAM-BAM extract: streams a bam once and keeps the reads the caller
+// would, with the bam's insert statistics, in an evidence file that
+// later runs take in place of the bam
 
-    seqidToInt[ (*sit).RefName ] = index;
+void extractEvidence(const string & bam, const string & out){
 
-    index+=1;
+  BamReader reader;
+  if(! reader.Open(bam) || ! reader.LocateIndex()){
+    cerr << "FATAL: cannot read - or find index for: " << bam << endl;
+    exit(1);
   }
 
-  ifstream featureFile (globalOpts.bed);
+  SamHeader SH = reader.GetHeader();
+  if(!SH.HasSortOrder()){
+    cerr << "FATAL: sorted bams must have the @HD SO: tag in each SAM header." << endl;
+    exit(1);
+  }
 
-  string line;
+  string headerText = reader.GetHeaderText();
 
-  if(featureFile.is_open()){
+  insertStats stats;
 
-    while(getline(featureFile, line)){
+  if(loadInsertStats(bam, headerText, stats)){
+    cerr << "INFO: insert statistics reused from: " << insertStatsPath(bam) << endl;
+  }
+  else{
+    long int nWindows = 0;
+    if(! sampleLibrary(bam, stats, &nWindows) || stats.nReads < 2){
+      cerr << "FATAL: no paired reads found in " << nWindows << " windows of: " << bam << endl;
+      exit(1);
+    }
+    saveInsertStats(bam, headerText, stats);
+    cerr << "INFO: sampled " << nWindows << " windows of: " << bam << endl;
+  }
 
-      vector<string> region = split(line, "\t");
+  readGroupIndex groups;
+  groups.addSample(SH);
 
-      int start = atoi(region[1].c_str()) ;
-      int end   = atoi(region[2].c_str()) ;
-  
-      regionDat * r = new regionDat;
-      r->seqidIndex = seqidToInt[region[0]];
-      r->start      = start;
-      r->end        = end  ;
-      features.push_back(r);
+  evidenceWriter writer;
+  if(! writer.open(out, headerText, reader.GetReferenceData(), stats)){
+    cerr << "FATAL: cannot write: " << out << endl;
+    exit(1);
+  }
+
+  BamAlignment  al  ;
+  alignmentTags tags;
+  long int      nIn = 0;
+
+  while(reader.GetNextAlignmentCore(al)){
+
+    nIn += 1;
+
+    if(! filterRead(al, tags)){
+      continue;
+    }
+    if(! addEvidence(writer, al, groups, 0, tags)){
+      cerr << "FATAL: " << bam << " is not sorted, or " << out << " could not be written" << endl;
+      exit(1);
     }
   }
-  else{
-    return false;
+
+  if(! writer.close()){
+    cerr << "FATAL: cannot write: " << out << endl;
+    exit(1);
   }
 
-  featureFile.close();
-  
-  return true;
+  cerr << "INFO: " << out << ": kept " << writer.nReads << " of " << nIn << " reads, " 
+       << writer.nInformative << " with their strings and tags, in " 
+       << writer.nBytes << " bytes" << endl;
 }
 
 int main(int argc, char** argv) {
@@ -2033,57 +3088,122 @@ int main(int argc, char** argv) {
 
   omp_init_lock(&lock);
 
-  srand((unsigned)time(NULL));
+  if(argc > 1 && string(argv[1]) == "mask-build"){
+    if(argc != 4){
+      cerr << "usage  : WHAM-BAM mask-build <kmers.txt> <kmers.bin>" << endl;
+      exit(1);
+    }
+    if(! kmerMask::build(argv[2], argv[3], KMER_LEN)){
+      cerr << "FATAL: could not build the masking database." << endl;
+      exit(1);
+    }
+    return 0;
+  }
+
+  if(argc > 1 && string(argv[1]) == "extract"){
+    if(argc != 4){
+      cerr << "usage  : WHAM-BAM extract <in.bam> <out.wev>" << endl;
+      exit(1);
+    }
+    extractEvidence(argv[2], argv[3]);
+    return 0;
+  }
 
   globalOpts.nthreads = -1;
 
   parseOpts(argc, argv);
+
+  cerr << "INFO: random seed: " << globalOpts.seed << " (rerun with --seed " << globalOpts.seed << " for the same calls)" << endl;
   
   if(globalOpts.nthreads == -1){
   }
   else{
     omp_set_num_threads(globalOpts.nthreads);
   }
+
+  for(int t = 0; t < omp_get_max_threads(); t++){
+    readerPools.push_back(new bamPool);
+    stageCounts.push_back(vector<long int>(N_SCORE_STAGES, 0));
+    genotypeScratch.push_back(vector<indvDat>());
+    glKernels.push_back(glKernel());
+    siteRandoms.push_back(siteRandom());
+    readsDownsampled.push_back(0);
+    samplePools.push_back(new bamPool);
+    if(globalOpts.assemble){
+      assemblers.push_back(new microAssembler);
+    }
+  }
  
   //loading up filenames into a vector
 
   globalOpts.all.reserve(globalOpts.targetBams.size()                          + globalOpts.backgroundBams.size() );
   globalOpts.all.insert( globalOpts.all.end(), globalOpts.targetBams.begin(),         globalOpts.targetBams.end() );
   globalOpts.all.insert( globalOpts.all.end(), globalOpts.backgroundBams.begin(), globalOpts.backgroundBams.end() );
+
+  resolveSamples();
+
+  globalOpts.readFrom = globalOpts.all;
+
+  // grabbing sam headers and checking for sorted bams; the references
+  // are taken from the first
+
+  RefVector sequences;
+
+  for(unsigned int s = 0; s < globalOpts.samples.size(); s++){
+    string    headerText;
+    RefVector refs;
+    if(! readHeader(globalOpts.samples[s], headerText, refs)){
+      cerr << "FATAL: cannot read - or find index for: " << globalOpts.samples[s] << endl;
+      exit(1);
+    }
+    SamHeader SH(headerText);
+    if(!SH.HasSortOrder()){
+      cerr << "FATAL: sorted bams must have the @HD SO: tag in each SAM header." << endl;
+      exit(1);
+    }
+    if(s == 0){
+      sequences = refs;
+    }
+    readGroups.addSample(SH);
+  }
+
+  // each read carries its bam's index in 16 bits
+
+  if(globalOpts.all.size() > 0xFFFF){
+    cerr << "FATAL: at most " << 0xFFFF << " bams can be read at once; " 
+	 << globalOpts.all.size() << " were given." << endl;
+    exit(1);
+  }
   
-  // loading kmer database
-  vector<uint64_t> kmerDB;
+  // loading kmer database; mapped once and shared by every thread
+  kmerMask kmerDB;
   if(! (globalOpts.mask.compare("NA") == 0)){
-    if(!loadKmerDB(kmerDB)){
+    if(!kmerDB.load(globalOpts.mask, KMER_LEN)){
       cerr << "FATAL: masking file was specified, but could not be opened or read." << endl;
       exit(1);
     }
+    cerr << "INFO: loaded " << kmerDB.size() << " masking kmers" << endl;
   }
 
   cerr << "INFO: gathering stats for each bam file." << endl;
   cerr << "INFO: this step can take a few minutes." << endl;
 
- #pragma omp parallel for
-  for(unsigned int i = 0; i < globalOpts.all.size(); i++){
-    grabInsertLengths(globalOpts.all[i]);
-  }
+  insertDists.mus.resize(globalOpts.samples.size());
+  insertDists.sds.resize(globalOpts.samples.size());
+  insertDists.avgD.resize(globalOpts.samples.size());
+  insertDists.lowCut.resize(readGroups.nGroups());
+  insertDists.highCut.resize(readGroups.nGroups());
+  sampleStats.resize(globalOpts.samples.size());
 
-  // the pooled reader
+  // one reader per bam; the number at once is capped, as this is all
+  // seeking and reading
 
-  BamMultiReader allReader;
+  int nReaders = min(omp_get_max_threads(), STATS_MAX_READERS);
 
-  // grabbing sam header and checking for sotrted bams
-  prepBams(allReader, "all");
-  SamHeader SH = allReader.GetHeader();
-  if(!SH.HasSortOrder()){
-    cerr << "FATAL: sorted bams must have the @HD SO: tag in each SAM header." << endl;
-    exit(1);
+ #pragma omp parallel for schedule(dynamic) num_threads(nReaders)
+  for(unsigned int i = 0; i < globalOpts.samples.size(); i++){
+    grabInsertLengths(i);
   }
-  allReader.Close();
-
-  prepBams(allReader, "all");  
-  RefVector sequences = allReader.GetReferenceData();
-  allReader.Close();
 
   printHeader();
 
@@ -2098,7 +3218,9 @@ int main(int argc, char** argv) {
     }
   }
 
-  if(seqidIndex != 0 || globalOpts.region.size() == 2 ){
+  bool single = seqidIndex != 0 || globalOpts.region.size() == 2;
+
+  if(single && ! globalOpts.twoPhase){
     if(! runRegion(seqidIndex, 
 		   globalOpts.region[0], 
 		   globalOpts.region[1], 
@@ -2106,58 +3228,155 @@ int main(int argc, char** argv) {
 		   kmerDB)){
       cerr << "WARNING: region failed to run properly." << endl;
     }
+    closeReaderPools();
     cerr << "INFO: WHAM-BAM finished normally." << endl;
     return 0;
   }
   
-  vector< regionDat* > regions; 
-  if(globalOpts.bed == "NA"){
-    for(vector< RefData >::iterator sit = sequences.begin(); sit != sequences.end(); sit++){
-      int start = 500;
-      if((*sit).RefLength < 2000){
-	cerr << "WARNING: " << (*sit).RefName << " is too short for WHAM-BAM: " << (*sit).RefLength << endl;
-	continue;
-      }
-      
-      for(;start < ( (*sit).RefLength - 500) ; start += 1000000){
-	regionDat * chunk = new regionDat;
-	chunk->seqidIndex = seqidIndex;
-	chunk->start      = start;
-	chunk->end        = start + 1000000 ;
-	regions.push_back(chunk);
-      }
-      regionDat * lastChunk = new regionDat;
-      lastChunk->seqidIndex = seqidIndex;
-      lastChunk->start = start;
-      lastChunk->end   = (*sit).RefLength;
-      seqidIndex += 1;
-      if(start < (*sit).RefLength){
-	regions.push_back(lastChunk);
-      }
-    }
+  vector< vector<double> > windows;
+  vector<regionTask>       tasks;
+
+  int nIndexed = 0;
+
+  if(! single){
+    nIndexed = indexWeights(sequences, windows);
+    cerr << "INFO: sizing regions from " << nIndexed << " of " 
+	 << globalOpts.all.size() << " BAM indices" << endl;
+  }
+
+  if(single){
+    regionTask task;
+    task.seqidIndex = seqidIndex;
+    task.start      = globalOpts.region[0];
+    task.end        = globalOpts.region[1];
+    task.weight     = double(task.end - task.start);
+    tasks.push_back(task);
+  }
+  else if(globalOpts.bed == "NA"){
+    depthChunks(sequences, windows, tasks);
   }
   else{
+    vector< regionDat* > regions; 
     loadBed(regions, sequences);
+    for(vector< regionDat* >::iterator it = regions.begin(); 
+	it != regions.end(); it++){
+      regionTask task;
+      task.seqidIndex = (*it)->seqidIndex;
+      task.start      = (*it)->start;
+      task.end        = (*it)->end;
+      task.weight     = (nIndexed > 0) 
+	? regionWeight(windows[task.seqidIndex], task.start, task.end) 
+	: double(task.end - task.start);
+      tasks.push_back(task);
+      delete (*it);
+    }
   }
 
- #pragma omp parallel for
-  
-  for(unsigned int re = 0; re < regions.size(); re++){
+  // the records are written in the order of the regions
 
-    omp_set_lock(&lock);
-    cerr << "INFO: running region: " << sequences[regions[re]->seqidIndex].RefName << ":" << regions[re]->start << "-" << regions[re]->end << endl;
-    omp_unset_lock(&lock);
+  sort(tasks.begin(), tasks.end(), genomicOrder);
 
-    if(! runRegion( regions[re]->seqidIndex, regions[re]->start, regions[re]->end, sequences, kmerDB)){
-      omp_set_lock(&lock);
-      cerr << "WARNING: region failed to run properly: " 
-	   << sequences[regions[re]->seqidIndex].RefName 
-	   << ":"  << regions[re]->start << "-" 
-	   << regions[re]->end 
-	   <<  endl;
-      omp_unset_lock(&lock);
+  // --two-phase: the regions are searched one bam at a time, each bam's
+  // reads around the sites found are gathered, and only those windows
+  // are scored with all of them
+
+  string scratch;
+
+  if(globalOpts.twoPhase){
+    vector< vector<clipGroup> > candidates;
+    discoverCandidates(tasks, sequences, kmerDB, candidates);
+
+    vector<regionTask> sites;
+    candidateWindows(tasks, candidates, sites);
+
+    long int nBases = 0;
+    for(vector<regionTask>::iterator it = sites.begin(); it != sites.end(); it++){
+      nBases += (*it).end - (*it).start;
+    }
+    cerr << "INFO: genotyping " << sites.size() << " windows covering " 
+	 << nBases << " bp" << endl;
+
+    tasks.swap(sites);
+
+    gatherWindows(tasks, sequences, scratch);
+  }
+
+  for(unsigned int i = 0; i < tasks.size(); i++){
+    tasks[i].ordinal = i;
+  }
+
+  // each thread starts with a contiguous run of regions holding an equal
+  // share of the work; the rest is balanced by stealing and splitting
+
+  int nThreads = omp_get_max_threads();
+
+  writer = new vcfWriter(tasks, nThreads, 64000000);
+
+  scheduler = new regionScheduler(nThreads, 50000, 1.0);
+
+  double total = 0;
+  for(vector<regionTask>::iterator it = tasks.begin(); it != tasks.end(); it++){
+    total += (*it).weight;
+  }
+
+  double before = 0;
+  for(vector<regionTask>::iterator it = tasks.begin(); it != tasks.end(); it++){
+    int t = (total > 0) ? int(before / total * nThreads) : 0;
+    scheduler->add(min(t, nThreads - 1), *it);
+    before += (*it).weight;
+  }
+
+  cerr << "INFO: " << tasks.size() << " regions queued" << endl;
+
+  // one more thread than regions are run on writes the output
+
+#pragma omp parallel num_threads(nThreads + 1)
+  {
+    int t        = omp_get_thread_num();
+    int nWorkers = min(omp_get_num_threads(), nThreads);
+
+    regionTask task;
+
+    if(t == nThreads){
+      writer->run();
+    }
+    else{
+      while(scheduler->next(t, task)){
+
+	writer->begin(t, task);
+
+	omp_set_lock(&lock);
+	cerr << "INFO: running region: " << sequences[task.seqidIndex].RefName << ":" << task.start << "-" << task.end << endl;
+	omp_unset_lock(&lock);
+
+	if(! runRegion( task.seqidIndex, task.start, task.end, sequences, kmerDB)){
+	  omp_set_lock(&lock);
+	  cerr << "WARNING: region failed to run properly: " 
+	       << sequences[task.seqidIndex].RefName 
+	       << ":"  << task.start << "-" 
+	       << task.end 
+	       <<  endl;
+	  omp_unset_lock(&lock);
+	}
+	scheduler->done(t, task);
+	writer->end(t, task);
+      }
+      writer->leave(nWorkers);
     }
+  }
+
+  // writes anything left if the writer thread was not given
+
+  writer->run();
+
+  delete writer;
+  writer = NULL;
+
+  closeScheduler();
+  closeReaderPools();
 
+  if(! scratch.empty()){
+    removeGathered(scratch);
   }
 
   cerr << "INFO: WHAM-BAM finished normally." << endl;
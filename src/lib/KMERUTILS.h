@@ -11,28 +11,28 @@ const uint64_t dnT = 1; // 01
 const uint64_t dnG = 2; // 10
 const uint64_t dnC = 3; // 11
 const char blank[] = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
-      char tests[] = "TCGAGAGGGGCCCAAAATTTTCCCCGGGCCCC";
+const char tests[] = "TCGAGAGGGGCCCAAAATTTTCCCCGGGCCCC";
 
-char dna_lookup[4] = {'A', 'T', 'G', 'C'};
+const char dna_lookup[4] = {'A', 'T', 'G', 'C'};
 
 // ascii printing characters
 
-uint8_t  ascii_lookup[130] = { 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 9
-                               5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 19
-                               5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 29
-                               5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 39
-                               5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 49
-                               5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 59
-                               5, 5, 5, 5, 5, 0, 5, 3, 5, 5,   // 69
-                               5, 2, 5, 5, 5, 5, 5, 5, 5, 5,   // 79
-                               5, 5, 5, 5, 1, 5, 5, 5, 5, 5,   // 89
-                               5, 5, 5, 5, 5, 5, 5, 0, 5, 3,   // 99
-                               5, 5, 5, 2, 5, 5, 5, 5, 5, 5,   // 109
-                               5, 5, 5, 5, 5, 5, 1, 5, 5, 5,   // 119
-                               5, 5, 5, 5, 5, 5, 5, 5, 5, 5 }; // 129
+const uint8_t  ascii_lookup[130] = { 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 9
+                                     5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 19
+                                     5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 29
+                                     5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 39
+                                     5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 49
+                                     5, 5, 5, 5, 5, 5, 5, 5, 5, 5,   // 59
+                                     5, 5, 5, 5, 5, 0, 5, 3, 5, 5,   // 69
+                                     5, 2, 5, 5, 5, 5, 5, 5, 5, 5,   // 79
+                                     5, 5, 5, 5, 1, 5, 5, 5, 5, 5,   // 89
+                                     5, 5, 5, 5, 5, 5, 5, 0, 5, 3,   // 99
+                                     5, 5, 5, 2, 5, 5, 5, 5, 5, 5,   // 109
+                                     5, 5, 5, 5, 5, 5, 1, 5, 5, 5,   // 119
+                                     5, 5, 5, 5, 5, 5, 5, 5, 5, 5 }; // 129
       
 
-uint8_t BinToChar(const uint64_t bin, char * dna){
+inline uint8_t BinToChar(const uint64_t bin, char * dna){
 
   uint64_t modBin = bin;
 
@@ -45,7 +45,7 @@ uint8_t BinToChar(const uint64_t bin, char * dna){
   return 1;
 }
 
-uint64_t charArrayToBin(char * trace, uint32_t offset){
+inline uint64_t charArrayToBin(char * trace, uint32_t offset){
   uint64_t bin = 0;
   for(uint32_t i = offset ; i < (offset + KMER_LEN) ; i++){
 //    printf("string length %d\t", (int)strlen(trace));
@@ -79,4 +79,58 @@ uint64_t charArrayToBin(char * trace, uint32_t offset){
   return bin;
 }
 
+// 2-bit codes in the encoding above for every byte; 4 for anything
+// that is not a base.  The complement of a code is code ^ 1.
+
+struct kmerCodeTable{
+  uint8_t code[256];
+  kmerCodeTable(void){
+    for(int i = 0; i < 256; i++){
+      code[i] = 4;
+    }
+    code['A'] = code['a'] = dnA;
+    code['T'] = code['t'] = dnT;
+    code['G'] = code['g'] = dnG;
+    code['C'] = code['c'] = dnC;
+  }
+};
+
+const kmerCodeTable kmer_codes;
+
+// Packs every k-mer (k <= 32) of seq[0, len) into out, which must have
+// room for len k-mers, and returns how many there are.  The encoding
+// rolls one base at a time; N or any other non-base restarts it, so
+// windows holding one are skipped.  With canonical set each k-mer is
+// the smaller of itself and its reverse complement.
+
+inline uint32_t rollingKmers(const char * seq, uint32_t len, uint32_t k,
+			     bool canonical, uint64_t * out){
+
+  const uint64_t mask  = (k >= 32) ? ~uint64_t(0) : ((uint64_t(1) << (2 * k)) - 1);
+  const uint32_t shift = 2 * (k - 1);
+
+  uint64_t fwd = 0;
+  uint64_t rev = 0;
+  uint32_t run = 0;
+  uint32_t n   = 0;
+
+  for(uint32_t i = 0; i < len; i++){
+    uint64_t c     = kmer_codes.code[(uint8_t) seq[i]];
+    uint32_t valid = (c < 4);
+
+    fwd = ((fwd << 2) | (c & 3)) & mask;
+    rev = (rev >> 2) | (((c & 3) ^ 1) << shift);
+    run = (run + 1) & (0 - valid);
+
+    uint64_t kmer = fwd;
+    if(canonical){
+      kmer = (rev < fwd) ? rev : fwd;
+    }
+
+    out[n] = kmer;
+    n     += (run >= k);
+  }
+  return n;
+}
+
 #endif
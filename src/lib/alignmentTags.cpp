@@ -0,0 +1,212 @@
+//
+//  alignmentTags.cpp
+//  wham
+//
+
+#include "alignmentTags.h"
+
+using namespace std;
+using namespace BamTools;
+
+// atoi over [s, e)
+
+static long int parseNumber(const char * s, const char * e){
+
+  while(s < e && (*s == ' ' || *s == '\t')){
+    s++;
+  }
+
+  bool negative = false;
+
+  if(s < e && (*s == '-' || *s == '+')){
+    negative = (*s == '-');
+    s++;
+  }
+
+  long int n = 0;
+
+  while(s < e && *s >= '0' && *s <= '9'){
+    n = n * 10 + (*s - '0');
+    s++;
+  }
+  return negative ? -n : n;
+}
+
+// first and last operation of a CIGAR string, and the M and I bases
+// it adds to the start position
+
+static void summarizeCigar(const char * s, const char * e, otherAlignment & o){
+
+  uint32_t length = 0;
+
+  o.end = o.pos;
+
+  for(; s < e; s++){
+    if(*s >= '0' && *s <= '9'){
+      length = length * 10 + (*s - '0');
+      continue;
+    }
+    switch(*s){
+    case 'M':
+    case 'I':
+      o.end += length;
+      // fall through
+    case 'D':
+    case 'N':
+    case 'S':
+    case 'H':
+    case 'P':
+    case 'X':
+    case '=':
+      if(o.frontType == 0){
+	o.frontType   = *s;
+	o.frontLength = length;
+      }
+      o.backType   = *s;
+      o.backLength = length;
+      length = 0;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static void clearEntry(otherAlignment & o){
+  o.seqid.offset = 0;
+  o.seqid.length = 0;
+  o.pos          = 0;
+  o.end          = 0;
+  o.frontLength  = 0;
+  o.backLength   = 0;
+  o.frontType    = 0;
+  o.backType     = 0;
+  o.strand       = 0;
+  o.mapQ         = 0;
+  o.nm           = 0;
+}
+
+static int parseTag(const char * tag, uint32_t length, bool xa,
+		    otherAlignment * entries, int max){
+
+  const char * s   = tag;
+  const char * end = tag + length;
+
+  int n = 0;
+
+  while(s < end){
+
+    const char * e = s;
+    while(e < end && *e != ';'){
+      e++;
+    }
+    if(e == s){
+      break;
+    }
+
+    otherAlignment o;
+    clearEntry(o);
+
+    const char * cigarStart = 0;
+    const char * cigarEnd   = 0;
+
+    int field = 0;
+
+    for(const char * f = s; f < e; field++){
+
+      const char * fe = f;
+      while(fe < e && *fe != ','){
+	fe++;
+      }
+
+      if(field == 0){
+	o.seqid.offset = f - tag;
+	o.seqid.length = fe - f;
+      }
+      else if(xa){
+	switch(field){
+	case 1:
+	  if(f < fe){
+	    o.strand = *f;
+	    o.pos    = parseNumber(f + 1, fe);
+	  }
+	  break;
+	case 2:
+	  cigarStart = f;
+	  cigarEnd   = fe;
+	  break;
+	case 3:
+	  o.nm = parseNumber(f, fe);
+	  break;
+	default:
+	  break;
+	}
+      }
+      else{
+	switch(field){
+	case 1:
+	  o.pos = parseNumber(f, fe);
+	  break;
+	case 2:
+	  o.strand = (f < fe) ? *f : 0;
+	  break;
+	case 3:
+	  cigarStart = f;
+	  cigarEnd   = fe;
+	  break;
+	case 4:
+	  o.mapQ = parseNumber(f, fe);
+	  break;
+	case 5:
+	  o.nm = parseNumber(f, fe);
+	  break;
+	default:
+	  break;
+	}
+      }
+      f = fe + 1;
+    }
+
+    summarizeCigar(cigarStart, cigarEnd, o);
+
+    if(n < max){
+      entries[n] = o;
+    }
+    n += 1;
+
+    s = e + 1;
+  }
+  return n;
+}
+
+int parseSaTag(const char * tag, uint32_t length, otherAlignment * entries, int max){
+  return parseTag(tag, length, false, entries, max);
+}
+
+int parseXaTag(const char * tag, uint32_t length, otherAlignment * entries, int max){
+  return parseTag(tag, length, true, entries, max);
+}
+
+alignmentTags::alignmentTags(){
+  nSa = 0;
+  nXa = 0;
+}
+
+void alignmentTags::clear(void){
+  sa.clear();
+  xa.clear();
+  nSa = 0;
+  nXa = 0;
+}
+
+void alignmentTags::load(BamAlignment & al){
+
+  clear();
+
+  if(al.GetTag("SA", sa)){
+    nSa = parseSaTag(sa.data(), sa.size(), saEntries, MAX_TAG_ENTRIES);
+  }
+  if(al.GetTag("XA", xa)){
+    nXa = parseXaTag(xa.data(), xa.size(), xaEntries, MAX_TAG_ENTRIES);
+  }
+}
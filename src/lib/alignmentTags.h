@@ -0,0 +1,51 @@
+//
+//  alignmentTags.h
+//  wham
+//
+//  The SA and XA tags of one read, fetched once and parsed in place
+//  into fixed arrays.  The filter reads the entry counts and the pileup
+//  copies the entries; neither splits the tags again.
+//
+
+#ifndef alignmentTags_h
+#define alignmentTags_h
+
+#include  "api/api_global.h"
+#include  "api/BamAlignment.h"
+#include  "whamRead.h"
+
+#include <string>
+
+// entries past this many are counted but not kept; reads with more than
+// one SA entry or XA hit are never clustered, so nothing reads them
+
+#define MAX_TAG_ENTRIES 8
+
+// parses "rname,pos,strand,CIGAR,mapQ,NM;..." (SA) or
+// "rname,[+-]pos,CIGAR,NM;..." (XA) up to the first empty entry; seqid
+// offsets are relative to the start of the tag.  Returns the number of
+// entries, which may be more than were stored.
+
+int parseSaTag(const char *, uint32_t, otherAlignment *, int);
+int parseXaTag(const char *, uint32_t, otherAlignment *, int);
+
+struct alignmentTags{
+
+  std::string sa;
+  std::string xa;
+
+  int nSa;
+  int nXa;
+
+  otherAlignment saEntries[MAX_TAG_ENTRIES];
+  otherAlignment xaEntries[MAX_TAG_ENTRIES];
+
+  alignmentTags();
+
+  // fetches and parses both tags; a read that was never decoded has none
+
+  void load(BamTools::BamAlignment &);
+  void clear(void);
+};
+
+#endif
@@ -0,0 +1,154 @@
+//
+//  baiIndex.cpp
+//  wham
+//
+
+#include "baiIndex.h"
+
+#include <fstream>
+#include <string.h>
+
+using namespace std;
+
+// the pseudo-bin samtools uses for the per-reference counts
+
+#define BAI_PSEUDO_BIN 37450
+
+static bool readInt32(ifstream & in, int32_t & v){
+  return bool(in.read((char *) &v, 4));
+}
+
+static bool readUint32(ifstream & in, uint32_t & v){
+  return bool(in.read((char *) &v, 4));
+}
+
+static bool readUint64(ifstream & in, uint64_t & v){
+  return bool(in.read((char *) &v, 8));
+}
+
+bool baiIndex::load(const string & bamFile){
+
+  refs.clear();
+
+  ifstream in((bamFile + ".bai").c_str(), ios::in | ios::binary);
+
+  if(! in.is_open() && bamFile.size() > 4
+     && bamFile.compare(bamFile.size() - 4, 4, ".bam") == 0){
+    string alt = bamFile.substr(0, bamFile.size() - 4) + ".bai";
+    in.open(alt.c_str(), ios::in | ios::binary);
+  }
+  if(! in.is_open()){
+    return false;
+  }
+
+  char magic[4];
+  if(! in.read(magic, 4) || memcmp(magic, "BAI\1", 4) != 0){
+    return false;
+  }
+
+  int32_t nRef;
+  if(! readInt32(in, nRef) || nRef < 0){
+    return false;
+  }
+
+  refs.resize(nRef);
+
+  for(int32_t r = 0; r < nRef; r++){
+
+    baiReference & ref = refs[r];
+
+    ref.endOffset = 0;
+    ref.mapped    = 0;
+    ref.unmapped  = 0;
+    ref.hasCounts = false;
+
+    int32_t nBin;
+    if(! readInt32(in, nBin)){
+      refs.clear();
+      return false;
+    }
+
+    for(int32_t b = 0; b < nBin; b++){
+
+      uint32_t bin;
+      int32_t  nChunk;
+
+      if(! readUint32(in, bin) || ! readInt32(in, nChunk)){
+	refs.clear();
+	return false;
+      }
+
+      for(int32_t c = 0; c < nChunk; c++){
+	uint64_t beg, end;
+	if(! readUint64(in, beg) || ! readUint64(in, end)){
+	  refs.clear();
+	  return false;
+	}
+	if(bin == BAI_PSEUDO_BIN){
+	  // first chunk: offsets of the reference, second: counts
+	  if(c == 1){
+	    ref.mapped    = beg;
+	    ref.unmapped  = end;
+	    ref.hasCounts = true;
+	  }
+	  continue;
+	}
+	if(end > ref.endOffset){
+	  ref.endOffset = end;
+	}
+      }
+    }
+
+    int32_t nIntv;
+    if(! readInt32(in, nIntv)){
+      refs.clear();
+      return false;
+    }
+
+    ref.linear.resize(nIntv);
+
+    for(int32_t i = 0; i < nIntv; i++){
+      if(! readUint64(in, ref.linear[i])){
+	refs.clear();
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+// the linear index holds the file offset of the first read overlapping
+// each window; consecutive differences of the compressed offsets are
+// the bytes of data in between.  Empty windows hold 0 or repeat the
+// previous offset, so they carry it forward and come out as 0 bytes.
+
+void baiIndex::addWindowBytes(int r, vector<double> & w) const {
+
+  if(r < 0 || r >= (int) refs.size()){
+    return;
+  }
+
+  const baiReference & ref = refs[r];
+
+  size_t n = ref.linear.size();
+
+  if(w.size() < n){
+    w.resize(n, 0);
+  }
+
+  vector<uint64_t> offsets(n + 1, 0);
+
+  uint64_t last = 0;
+
+  for(size_t i = 0; i <= n; i++){
+    uint64_t here = (i == n) ? (ref.endOffset >> 16) : (ref.linear[i] >> 16);
+    if(here > last){
+      last = here;
+    }
+    offsets[i] = last;
+  }
+
+  for(size_t i = 0; i < n; i++){
+    w[i] += double(offsets[i + 1] - offsets[i]);
+  }
+}
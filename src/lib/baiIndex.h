@@ -0,0 +1,43 @@
+//
+//  baiIndex.h
+//  wham
+//
+//  A reader for the parts of a BAM index (.bai) that say where the data
+//  is: the 16 kb linear index and, when present, the per-reference
+//  mapped and unmapped read counts.  BamTools keeps these private.
+//
+
+#ifndef baiIndex_h
+#define baiIndex_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define BAI_WINDOW 16384
+
+struct baiReference{
+  std::vector<uint64_t> linear   ;  // virtual offset of the first read in each window
+  uint64_t              endOffset;  // virtual offset past the last read
+  uint64_t              mapped   ;
+  uint64_t              unmapped ;
+  bool                  hasCounts;
+};
+
+class baiIndex {
+
+ public:
+
+  std::vector<baiReference> refs;
+
+  // looks for file.bam.bai, then file.bai
+
+  bool load(const std::string &);
+
+  // compressed bytes of the reads that start in each window of a
+  // reference, added onto w (which is grown as needed)
+
+  void addWindowBytes(int, std::vector<double> &) const;
+};
+
+#endif
@@ -0,0 +1,217 @@
+//
+//  bamPool.cpp
+//  wham
+//
+
+#include "bamPool.h"
+
+#include <algorithm>
+#include <time.h>
+
+using namespace std;
+using namespace BamTools;
+
+// orders reader indices so the heap front holds the leftmost alignment;
+// unmapped reads (RefID -1) sort last, ties go to the earlier file
+
+struct laterAlignment{
+  vector<BamAlignment> * next;
+  laterAlignment(vector<BamAlignment> * n) : next(n) {}
+  bool operator()(int a, int b) const {
+    unsigned int ra = (unsigned int) (*next)[a].RefID;
+    unsigned int rb = (unsigned int) (*next)[b].RefID;
+    if(ra != rb){
+      return ra > rb;
+    }
+    if((*next)[a].Position != (*next)[b].Position){
+      return (*next)[a].Position > (*next)[b].Position;
+    }
+    return a > b;
+  }
+};
+
+double bamPool::wallTime(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+}
+
+bamPool::bamPool(){
+  nOpened     = 0;
+  nRegions    = 0;
+  openSeconds = 0;
+  seekSeconds = 0;
+  scanSeconds = 0;
+  last        = -1;
+  hash        = 0;
+}
+
+bamPool::~bamPool(){
+  close();
+}
+
+bool bamPool::isOpen(void){
+  return ! readers.empty();
+}
+
+int bamPool::nFiles(void){
+  return files.size();
+}
+
+string & bamPool::filename(int i){
+  return files[i];
+}
+
+string bamPool::errorString(void){
+  string errors;
+  for(unsigned int i = 0; i < readers.size(); i++){
+    string e = evidence[i] != NULL ? evidence[i]->error 
+      : readers[i]->GetErrorString();
+    if(! e.empty()){
+      errors.append(files[i] + ": " + e + "\n");
+    }
+  }
+  return errors;
+}
+
+void bamPool::close(void){
+  for(vector<BamReader *>::iterator it = readers.begin();
+      it != readers.end(); it++){
+    (*it)->Close();
+    delete (*it);
+  }
+  for(vector<evidenceReader *>::iterator it = evidence.begin();
+      it != evidence.end(); it++){
+    delete (*it);
+  }
+  readers.clear();
+  evidence.clear();
+  next.clear();
+  hashes.clear();
+  heap.clear();
+  last = -1;
+}
+
+// opens every file and loads its index; retries like prepBams did,
+// since a busy filesystem can refuse the odd open
+
+bool bamPool::open(vector<string> & fileNames, bool keepOpen){
+
+  double start = wallTime();
+
+  close();
+
+  files = fileNames;
+
+  for(vector<string>::iterator it = files.begin();
+      it != files.end(); it++){
+
+    BamReader * reader = new BamReader;
+    readers.push_back(reader);
+    evidence.push_back(NULL);
+
+    bool isEvidence = evidenceReader::isEvidence(*it);
+
+    if(isEvidence){
+      evidence.back() = new evidenceReader;
+    }
+
+    int tried = 0;
+
+    while(tried < 500){
+      if(isEvidence ? evidence.back()->open(*it, keepOpen)
+	 : (reader->Open(*it) && reader->LocateIndex())){
+	break;
+      }
+      reader->Close();
+      tried += 1;
+    }
+    if(tried == 500){
+      openSeconds += wallTime() - start;
+      return false;
+    }
+    nOpened += 1;
+  }
+
+  next.resize(readers.size());
+  hashes.resize(readers.size());
+  heap.reserve(readers.size());
+
+  openSeconds += wallTime() - start;
+
+  return true;
+}
+
+bool bamPool::fill(int r){
+  if(evidence[r] != NULL ? ! evidence[r]->getNextAlignment(next[r], hashes[r])
+     : ! readers[r]->GetNextAlignmentCore(next[r])){
+    return false;
+  }
+  heap.push_back(r);
+  push_heap(heap.begin(), heap.end(), laterAlignment(&next));
+  return true;
+}
+
+// jumps every reader to the region and primes the merge; a reader that
+// cannot jump simply contributes no reads
+
+bool bamPool::setRegion(int seqid, int start, int end){
+
+  double t = wallTime();
+
+  heap.clear();
+  last = -1;
+
+  bool any = false;
+
+  for(unsigned int r = 0; r < readers.size(); r++){
+    if(evidence[r] != NULL ? ! evidence[r]->setRegion(seqid, start, end)
+       : ! readers[r]->SetRegion(seqid, start, seqid, end)){
+      continue;
+    }
+    any = true;
+    fill(r);
+  }
+
+  nRegions    += 1;
+  seekSeconds += wallTime() - t;
+
+  return any;
+}
+
+bool bamPool::getNextAlignmentCore(BamAlignment & al, int * sample){
+
+  if(heap.empty()){
+    return false;
+  }
+
+  pop_heap(heap.begin(), heap.end(), laterAlignment(&next));
+
+  int r = heap.back();
+  heap.pop_back();
+
+  al      = next[r];
+  hash    = hashes[r];
+  last    = r;
+  *sample = r;
+
+  fill(r);
+
+  return true;
+}
+
+const uint64_t * bamPool::nameHash(void) const {
+  return last >= 0 && evidence[last] != NULL ? &hash : NULL;
+}
+
+bool bamPool::getNextAlignment(BamAlignment & al, int * sample){
+
+  if(! getNextAlignmentCore(al, sample)){
+    return false;
+  }
+
+  al.BuildCharData();
+  al.Filename = files[*sample];
+
+  return true;
+}
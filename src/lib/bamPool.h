@@ -0,0 +1,86 @@
+//
+//  bamPool.h
+//  wham
+//
+//  A long-lived set of BAM readers, one per file, merged by position.
+//  Each OpenMP thread owns one pool: the files, headers and indices are
+//  loaded once and every new region only costs a jump per reader.
+//  Evidence files written by "WHAM-BAM extract" can stand in for any of
+//  the BAMs; they are told apart by their magic.
+//
+
+#ifndef bamPool_h
+#define bamPool_h
+
+#include  "api/api_global.h"
+#include  "api/BamReader.h"
+#include  "evidenceFile.h"
+
+#include <string>
+#include <vector>
+
+class bamPool {
+
+ private:
+
+  std::vector<std::string>            files  ;
+  std::vector<BamTools::BamReader *>  readers;
+  std::vector<evidenceReader *>       evidence;  // NULL for a BAM
+
+  // one alignment of lookahead per reader and a min-heap of the
+  // readers that still have one, ordered by position
+
+  std::vector<BamTools::BamAlignment> next   ;
+  std::vector<uint64_t>               hashes ;  // of next, evidence only
+  std::vector<int>                    heap   ;
+
+  int                                 last   ;  // reader of the last read
+  uint64_t                            hash   ;
+
+  bool fill(int);
+
+ public:
+
+  // bookkeeping so we can see where the time goes
+
+  long   nOpened     ;
+  long   nRegions    ;
+  double openSeconds ;
+  double seekSeconds ;
+  double scanSeconds ;
+
+  bamPool() ;
+  ~bamPool();
+
+  // keepOpen only applies to evidence files: without it they hold no
+  // descriptor between regions; BAMs always stay open
+
+  bool open(std::vector<std::string> &, bool keepOpen = true);
+  bool isOpen(void);
+  void close(void);
+
+  bool setRegion(int, int, int);
+
+  // the core fields (flag, MAPQ, CIGAR, positions) only; strings and
+  // tags stay packed until BuildCharData() is called on the alignment
+
+  bool getNextAlignmentCore(BamTools::BamAlignment &, int *);
+
+  // the name hash of the last read when an evidence file gave it, since
+  // those keep no name for reads the pileup does not decode; NULL after
+  // a BAM read, whose name BuildCharData() gives
+
+  const uint64_t * nameHash(void) const;
+
+  // fully decoded, with the filename set, like BamMultiReader
+
+  bool getNextAlignment(BamTools::BamAlignment &, int *);
+
+  int  nFiles(void);
+  std::string & filename(int);
+  std::string errorString(void);
+
+  static double wallTime(void);
+};
+
+#endif
@@ -0,0 +1,399 @@
+//
+//  clipConsensus.cpp
+//  wham
+//
+
+#include "clipConsensus.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+using namespace std;
+
+#define MATCH      2
+#define MISMATCH  -3
+#define GAP       -4
+#define NO_SCORE  -100000000
+
+// traceback moves
+
+#define FROM_DIAG 0
+#define FROM_UP   1   // base of the clip inserted into the backbone
+#define FROM_LEFT 2   // backbone base missing from the clip
+
+// A, C, G, T, then N or anything else, which only counts as coverage
+
+struct columnVote{
+  double base[5];
+  double gap    ;
+};
+
+// one clip turned to start at the boundary, with a weight per base
+
+struct anchoredClip{
+  string          bases  ;
+  vector<uint8_t> codes  ;  // baseIndex of each base
+  vector<double>  weights;
+  double          average;
+};
+
+static int baseIndex(char c){
+  switch(c){
+  case 'A': case 'a': return 0;
+  case 'C': case 'c': return 1;
+  case 'G': case 'g': return 2;
+  case 'T': case 't': return 3;
+  default: return 4;
+  }
+}
+
+static void clearVote(columnVote & v){
+  v.base[0] = v.base[1] = v.base[2] = v.base[3] = v.base[4] = 0;
+  v.gap     = 0;
+}
+
+static void anchor(const clippedSequence & s, bool reverse, anchoredClip & a){
+
+  a.bases = s.bases;
+  a.weights.resize(s.bases.size());
+
+  bool hasQuals = s.quals.size() == s.bases.size();
+
+  double sum = 0;
+
+  for(size_t i = 0; i < s.bases.size(); i++){
+    double w = 20;
+    if(hasQuals){
+      w = double(int(s.quals[i]) - 33);
+      if(w < 2){
+	w = 2;
+      }
+      if(w > 41){
+	w = 41;
+      }
+    }
+    a.weights[i] = w;
+    sum += w;
+  }
+
+  a.average = s.bases.empty() ? 1 : sum / double(s.bases.size());
+
+  if(reverse){
+    std::reverse(a.bases.begin(), a.bases.end());
+    std::reverse(a.weights.begin(), a.weights.end());
+  }
+
+  a.codes.resize(a.bases.size());
+  for(size_t i = 0; i < a.bases.size(); i++){
+    a.codes[i] = baseIndex(a.bases[i]);
+  }
+}
+
+// Aligns q to the backbone b, both starting at their first base, within
+// a band around the diagonal.  The alignment ends when either runs out.
+// Fills col with the backbone column of each clip base, or -1 - t for a
+// base inserted before column t (t = L after the last one), and returns
+// the last column reached.
+
+static int bandedAnchored(const vector<uint8_t> & b, const vector<uint8_t> & q,
+			  vector<int> & col, vector<int> & score,
+			  vector<uint8_t> & move){
+
+  const int band   = CONSENSUS_BAND;
+  const int width  = 2 * band + 1;
+  const int stride = width + 2;
+
+  // N scores nothing either way
+
+  static const int subst[5][5] = {
+    {    MATCH, MISMATCH, MISMATCH, MISMATCH, 0 },
+    { MISMATCH,    MATCH, MISMATCH, MISMATCH, 0 },
+    { MISMATCH, MISMATCH,    MATCH, MISMATCH, 0 },
+    { MISMATCH, MISMATCH, MISMATCH,    MATCH, 0 },
+    {        0,        0,        0,        0, 0 } };
+
+  int L = b.size();
+  int m = q.size();
+
+  // cell (i, j) is kept at i * stride + d + 1, d = j - i + band.  The
+  // slots either side of a row and the cells off the ends of the
+  // backbone hold NO_SCORE, which no path can climb out of.
+
+  score.assign((m + 1) * stride, NO_SCORE);
+  move.assign((m + 1) * stride, FROM_LEFT);
+
+  score[band + 1] = 0;
+
+  for(int d = band + 1; d < width && d - band <= L; d++){
+    score[d + 1] = score[d] + GAP;
+  }
+
+  for(int i = 1; i <= m; i++){
+
+    const int * prev = &score[(i - 1) * stride + 1];
+    int       * cur  = &score[i * stride + 1];
+    uint8_t   * mv   = &move[i * stride + 1];
+
+    const int * row  = subst[q[i - 1]];
+
+    // the first column and the columns past the backbone are skipped
+
+    int dLow  = max(0, band - i + 1);
+    int dHigh = min(width - 1, L - i + band);
+
+    if(band - i >= 0){
+      cur[band - i] = prev[band - i + 1] + GAP;
+      mv[band - i]  = FROM_UP;
+    }
+
+    for(int d = dLow; d <= dHigh; d++){
+
+      int diag = prev[d] + row[b[i + d - band - 1]];
+      int up   = prev[d + 1] + GAP;
+      int left = cur[d - 1]  + GAP;
+
+      int     best = diag;
+      uint8_t from = FROM_DIAG;
+
+      from = (up > best)   ? FROM_UP   : from;
+      best = (up > best)   ? up        : best;
+      from = (left > best) ? FROM_LEFT : from;
+      best = (left > best) ? left      : best;
+
+      cur[d] = best;
+      mv[d]  = from;
+    }
+  }
+
+  // best end: the clip used up, or the backbone used up and the rest of
+  // the clip hangs off its end
+
+  int endI = 0;
+  int endJ = 0;
+  int best = NO_SCORE;
+
+  for(int j = max(0, m - band); j <= min(L, m + band); j++){
+    int s = score[m * stride + j - m + band + 1];
+    if(s > best){
+      best = s;
+      endI = m;
+      endJ = j;
+    }
+  }
+  for(int i = max(0, L - band); i <= min(m, L + band); i++){
+    int s = score[i * stride + L - i + band + 1];
+    if(s > best){
+      best = s;
+      endI = i;
+      endJ = L;
+    }
+  }
+
+  col.assign(m, 0);
+
+  // the overhang is inserted after the last column
+
+  for(int i = endI; i < m; i++){
+    col[i] = -1 - L;
+  }
+
+  int i = endI;
+  int j = endJ;
+
+  while(i > 0 || j > 0){
+    int from = move[i * stride + j - i + band + 1];
+    if(i > 0 && (j == 0 || from == FROM_UP)){
+      col[i - 1] = -1 - j;
+      i -= 1;
+    }
+    else if(from == FROM_DIAG && i > 0){
+      col[i - 1] = j - 1;
+      i -= 1;
+      j -= 1;
+    }
+    else{
+      j -= 1;
+    }
+  }
+
+  return endJ - 1;
+}
+
+// a clip that matches the start of the backbone already scores the most
+// any alignment can, so it needs no alignment
+
+static bool prefixOf(const vector<uint8_t> & b, const vector<uint8_t> & q){
+  if(q.size() > b.size()){
+    return false;
+  }
+  for(size_t i = 0; i < q.size(); i++){
+    if(q[i] != b[i] && q[i] != 4 && b[i] != 4){
+      return false;
+    }
+  }
+  return true;
+}
+
+// the winning base of a column, N when it is contested or only N was
+// seen, or 0 when the column is mostly gap
+
+static char callColumn(const columnVote & v, bool gapWinsTies, double * nn){
+
+  double known = v.base[0] + v.base[1] + v.base[2] + v.base[3];
+  double bases = known + v.base[4];
+
+  if(bases <= 0 || v.gap > bases || (gapWinsTies && v.gap == bases)){
+    return 0;
+  }
+
+  int top = 0;
+  for(int b = 1; b < 4; b++){
+    if(v.base[b] > v.base[top]){
+      top = b;
+    }
+  }
+
+  if(known <= 0 || v.base[top] < CONSENSUS_AGREE * known){
+    *nn += 1;
+    return 'N';
+  }
+  return "ACGT"[top];
+}
+
+string clipConsensus(const vector<clippedSequence> & clips,
+		     bool anchoredAtEnd, double * nn){
+
+  if(clips.empty()){
+    return ".";
+  }
+
+  vector<anchoredClip> seqs(clips.size());
+
+  size_t longest = 0;
+
+  for(size_t s = 0; s < clips.size(); s++){
+    anchor(clips[s], anchoredAtEnd, seqs[s]);
+    if(seqs[s].bases.size() > seqs[longest].bases.size()){
+      longest = s;
+    }
+  }
+
+  const vector<uint8_t> & backbone = seqs[longest].codes;
+
+  int L = backbone.size();
+
+  // columns, and the insertions before each column (slot L is after
+  // the last)
+
+  vector<columnVote>          columns(L);
+  vector< vector<columnVote> > inserts(L + 1);
+
+  for(int j = 0; j < L; j++){
+    clearVote(columns[j]);
+  }
+
+  // per clip: the last column it reached and its insertions per slot
+
+  vector<int>           lastCol(seqs.size());
+  vector< vector<int> > nInserted(seqs.size());
+
+  vector<int>     col;
+  vector<int>     score;
+  vector<uint8_t> move;
+
+  for(size_t s = 0; s < seqs.size(); s++){
+
+    const anchoredClip & a = seqs[s];
+
+    if(s == longest){
+      col.resize(L);
+      for(int j = 0; j < L; j++){
+	col[j] = j;
+      }
+      lastCol[s] = L - 1;
+    }
+    else if(prefixOf(backbone, a.codes)){
+      col.resize(a.bases.size());
+      for(size_t i = 0; i < a.bases.size(); i++){
+	col[i] = i;
+      }
+      lastCol[s] = a.bases.size() - 1;
+    }
+    else{
+      lastCol[s] = bandedAnchored(backbone, a.codes, col, score, move);
+    }
+
+    nInserted[s].assign(L + 1, 0);
+
+    int reached = -1;
+
+    for(size_t i = 0; i < a.bases.size(); i++){
+
+      int b = a.codes[i];
+
+      if(col[i] >= 0){
+
+	// backbone columns skipped since the last base are deletions
+
+	for(int j = reached + 1; j < col[i]; j++){
+	  columns[j].gap += a.average;
+	}
+	reached = col[i];
+
+	columns[col[i]].base[b] += a.weights[i];
+	continue;
+      }
+
+      int slot = -1 - col[i];
+      int k    = nInserted[s][slot];
+
+      nInserted[s][slot] += 1;
+
+      if((int) inserts[slot].size() <= k){
+	columnVote v;
+	clearVote(v);
+	inserts[slot].push_back(v);
+      }
+      inserts[slot][k].base[b] += a.weights[i];
+    }
+    for(int j = reached + 1; j <= lastCol[s]; j++){
+      columns[j].gap += seqs[s].average;
+    }
+  }
+
+  // clips that pass a slot without filling it vote against it
+
+  for(int slot = 0; slot <= L; slot++){
+    for(size_t k = 0; k < inserts[slot].size(); k++){
+      for(size_t s = 0; s < seqs.size(); s++){
+	if(lastCol[s] >= slot && nInserted[s][slot] <= (int) k){
+	  inserts[slot][k].gap += seqs[s].average;
+	}
+      }
+    }
+  }
+
+  string con;
+  con.reserve(L + 8);
+
+  for(int slot = 0; slot <= L; slot++){
+    if(slot > 0){
+      char c = callColumn(columns[slot - 1], false, nn);
+      if(c != 0){
+	con += c;
+      }
+    }
+    for(size_t k = 0; k < inserts[slot].size(); k++){
+      char c = callColumn(inserts[slot][k], true, nn);
+      if(c != 0){
+	con += c;
+      }
+    }
+  }
+
+  if(anchoredAtEnd){
+    reverse(con.begin(), con.end());
+  }
+
+  return con;
+}
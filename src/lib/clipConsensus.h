@@ -0,0 +1,34 @@
+//
+//  clipConsensus.h
+//  wham
+//
+//  Consensus of the soft clips at a breakpoint.  The clips all start at
+//  the clip boundary, so each one is aligned to the longest as an
+//  anchored prefix with a small banded DNA alignment, and the columns
+//  (plus any insertions into the longest clip) are voted on with the
+//  base qualities.  Clips that end at the boundary are turned around
+//  first and the consensus is turned back.
+//
+
+#ifndef clipConsensus_h
+#define clipConsensus_h
+
+#include <string>
+#include <vector>
+
+#define CONSENSUS_MAX_CLIPS  21   // clips voted on per site
+#define CONSENSUS_BAND        8   // widest indel drift between two clips
+#define CONSENSUS_AGREE     0.8   // weight the winning base needs, else N
+
+struct clippedSequence{
+  std::string bases;
+  std::string quals;  // phred + 33; empty when the read had none
+};
+
+// anchoredAtEnd: the clips end at the boundary (front clips).  The
+// number of N columns is added onto nn.
+
+std::string clipConsensus(const std::vector<clippedSequence> &,
+			  bool anchoredAtEnd, double * nn);
+
+#endif
@@ -0,0 +1,99 @@
+//
+//  clipFrontier.cpp
+//  wham
+//
+
+#include "clipFrontier.h"
+
+using namespace std;
+
+clipFrontier::clipFrontier(){
+  counts.assign(1024, 0);
+  mask  = 1023;
+  low   = 0;
+  high  = 0;
+  nKeys = 0;
+}
+
+// makes room for span keys from low; the live counts move to their
+// slots in the bigger ring
+
+void clipFrontier::grow(long int span){
+
+  size_t n = counts.size();
+  while((long int) n < span){
+    n *= 2;
+  }
+
+  vector<uint32_t> bigger(n, 0);
+
+  for(long int k = low; k < high; k++){
+    bigger[k & (n - 1)] = counts[k & mask];
+  }
+  counts.swap(bigger);
+  mask = n - 1;
+}
+
+void clipFrontier::add(long int key){
+
+  if(nKeys == 0){
+    low  = key;
+    high = key + 1;
+  }
+  else if(key < low){
+    if(high - key > (long int) counts.size()){
+      grow(high - key);
+    }
+    low = key;
+  }
+  else if(key >= high){
+    if(key + 1 - low > (long int) counts.size()){
+      grow(key + 1 - low);
+    }
+    high = key + 1;
+  }
+
+  uint32_t & c = counts[key & mask];
+  if(c == 0){
+    nKeys += 1;
+  }
+  c += 1;
+}
+
+bool clipFrontier::empty(void) const {
+  return nKeys == 0;
+}
+
+long int clipFrontier::front(void){
+  while(counts[low & mask] == 0 && low < high){
+    low += 1;
+  }
+  return low;
+}
+
+long int clipFrontier::back(void) const {
+  return high - 1;
+}
+
+uint32_t clipFrontier::count(long int key) const {
+  if(key < low || key >= high){
+    return 0;
+  }
+  return counts[key & mask];
+}
+
+void clipFrontier::popThrough(long int key){
+
+  while(nKeys > 0 && front() <= key){
+    counts[low & mask] = 0;
+    nKeys -= 1;
+    low   += 1;
+  }
+  if(nKeys == 0){
+    high = low;
+  }
+}
+
+void clipFrontier::clear(void){
+  popThrough(high);
+}
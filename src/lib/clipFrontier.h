@@ -0,0 +1,48 @@
+//
+//  clipFrontier.h
+//  wham
+//
+//  The clipped positions runRegion() has still to score.  Keys are
+//  counted in a ring of buckets, one per key, covering the span from
+//  the smallest live key to the largest; a key seen twice only bumps its
+//  count.  The reads come in by position, so the keys stay within about
+//  a read length of the front and the ring rarely has to grow.
+//
+
+#ifndef clipFrontier_h
+#define clipFrontier_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class clipFrontier {
+
+ private:
+
+  std::vector<uint32_t> counts;  // copies of key k at k & mask
+  size_t   mask ;
+  long int low  ;  // no live key is smaller
+  long int high ;  // one past the largest live key
+  size_t   nKeys;  // distinct live keys
+
+  void grow(long int);
+
+ public:
+
+  clipFrontier();
+
+  void add(long int);
+
+  bool     empty(void) const;
+  long int front(void);           // the smallest live key
+  long int back(void) const;      // no live key is larger
+  uint32_t count(long int) const;
+
+  // drops every key up to and including the given one
+
+  void popThrough(long int);
+  void clear(void);
+};
+
+#endif
@@ -0,0 +1,77 @@
+//
+//  clusterIndex.cpp
+//  wham
+//
+
+#include "clusterIndex.h"
+
+#include <algorithm>
+
+using namespace std;
+
+struct entryBefore{
+  bool operator()(const clusterEntry & a, long int key) const {
+    return a.key < key;
+  }
+  bool operator()(long int key, const clusterEntry & a) const {
+    return key < a.key;
+  }
+};
+
+clusterIndex::clusterIndex(){
+  nKeys = 0;
+}
+
+// new reads go after the ones already at the breakpoint
+
+void clusterIndex::add(long int key, uint32_t serial){
+
+  vector<clusterEntry>::iterator it = upper_bound(entries.begin(),
+						  entries.end(),
+						  key, entryBefore());
+
+  if(it == entries.begin() || (*(it - 1)).key != key){
+    nKeys += 1;
+  }
+
+  clusterEntry e = {key, serial};
+
+  entries.insert(it, e);
+}
+
+void clusterIndex::remove(long int key, uint32_t serial){
+
+  pair<vector<clusterEntry>::iterator, vector<clusterEntry>::iterator> r
+    = equal_range(entries.begin(), entries.end(), key, entryBefore());
+
+  for(vector<clusterEntry>::iterator it = r.first; it != r.second; it++){
+    if((*it).serial == serial){
+      if(r.second - r.first == 1){
+	nKeys -= 1;
+      }
+      entries.erase(it);
+      return;
+    }
+  }
+}
+
+clusterRange clusterIndex::at(long int key) const {
+
+  pair<vector<clusterEntry>::const_iterator, vector<clusterEntry>::const_iterator> r
+    = equal_range(entries.begin(), entries.end(), key, entryBefore());
+
+  clusterRange c;
+  c.first = entries.data() + (r.first  - entries.begin());
+  c.last  = entries.data() + (r.second - entries.begin());
+
+  return c;
+}
+
+size_t clusterIndex::size(void) const {
+  return nKeys;
+}
+
+void clusterIndex::clear(void){
+  entries.clear();
+  nKeys = 0;
+}
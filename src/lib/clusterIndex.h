@@ -0,0 +1,55 @@
+//
+//  clusterIndex.h
+//  wham
+//
+//  Clipped reads grouped by breakpoint.  Each entry is a breakpoint and
+//  the serial of a read in the pileup queue; entries are kept sorted by
+//  breakpoint in one flat array, and reads at the same breakpoint stay
+//  in the order they were added.
+//
+
+#ifndef clusterIndex_h
+#define clusterIndex_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+struct clusterEntry{
+  long int key   ;  // breakpoint
+  uint32_t serial;  // whamRead::serial
+};
+
+struct clusterRange{
+  const clusterEntry * first;
+  const clusterEntry * last ;
+
+  size_t size(void)  const { return last - first;  }
+  bool   empty(void) const { return last == first; }
+};
+
+class clusterIndex {
+
+ private:
+
+  std::vector<clusterEntry> entries;
+  size_t nKeys;
+
+ public:
+
+  clusterIndex();
+
+  void add   (long int, uint32_t);
+  void remove(long int, uint32_t);
+
+  // the reads clipped at a breakpoint; empty if there are none
+
+  clusterRange at(long int) const;
+
+  // number of breakpoints with at least one read
+
+  size_t size(void) const;
+  void   clear(void);
+};
+
+#endif
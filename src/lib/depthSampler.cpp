@@ -0,0 +1,92 @@
+//
+//  depthSampler.cpp
+//  wham
+//
+
+#include "depthSampler.h"
+#include "readNameSet.h"
+
+using namespace std;
+
+depthSampler::depthSampler(int cap){
+  maxDepth = cap;
+  nDropped = 0;
+}
+
+bool depthSampler::keep(BamTools::BamAlignment & al, const uint64_t * nameHash){
+
+  if(maxDepth <= 0){
+    return true;
+  }
+
+  long int start = al.Position;
+  long int end   = al.GetEndPosition(false, true);
+
+  while(! ends.empty() && ends.top() < start){
+    ends.pop();
+  }
+  ends.push(end);
+
+  long int depth = ends.size();
+
+  if(depth <= maxDepth){
+    return true;
+  }
+
+  int level = 0;
+  while(level < 63 && (depth >> level) > maxDepth){
+    level += 1;
+  }
+
+  // the name is only decoded once a read is in a deep spot; decoding
+  // again later is free
+
+  uint64_t h;
+  if(nameHash != NULL){
+    h = *nameHash;
+  }
+  else{
+    al.BuildCharData();
+    h = hashReadName(al.Name.data(), al.Name.size());
+  }
+
+  // FNV leaves its low bits weak, so the level is read from the top
+  // bits of the hash spread by a multiply
+
+  h *= 0x9e3779b97f4a7c15ULL;
+
+  if((h >> (64 - level)) == 0){
+    return true;
+  }
+
+  nDropped += 1;
+
+  if(! spans.empty() && start <= spans.back().second + 1){
+    if(end > spans.back().second){
+      spans.back().second = end;
+    }
+  }
+  else{
+    spans.push_back(make_pair(start, end));
+  }
+  return false;
+}
+
+bool depthSampler::downsampled(long int pos) const {
+
+  // the spans are few and the ones asked about sit at the front
+
+  for(deque< pair<long int, long int> >::const_iterator it = spans.begin();
+      it != spans.end() && it->first <= pos; it++){
+    if(pos <= it->second){
+      return true;
+    }
+  }
+  return false;
+}
+
+void depthSampler::purgeBefore(long int pos){
+  while(! spans.empty() && spans.front().second < pos){
+    spans.pop_front();
+  }
+}
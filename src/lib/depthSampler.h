@@ -0,0 +1,63 @@
+//
+//  depthSampler.h
+//  wham
+//
+//  Bounds the depth runRegion() loads with --max-depth.  The raw depth
+//  is the number of filtered reads over the start of the incoming read.
+//  Past the cap, a read is kept only when its name hashes into the top
+//  1 / 2^k of the hash space, with 2^k the smallest power of two that
+//  brings the raw depth down to the cap.  The decision depends only on
+//  the name hash and the depth level, so both mates of a pair in the same
+//  deep spot are kept or dropped together, and a read kept at one level
+//  is kept at every shallower one.
+//
+//  The spans covered by dropped reads are remembered, so the calls made
+//  over them can be flagged.
+//
+
+#ifndef depthSampler_h
+#define depthSampler_h
+
+#include  "api/BamAlignment.h"
+
+#include <stdint.h>
+#include <deque>
+#include <queue>
+#include <vector>
+
+class depthSampler {
+
+ private:
+
+  int maxDepth;
+
+  // ends of the raw reads still over the current position
+
+  std::priority_queue<long int, std::vector<long int>,
+                      std::greater<long int> > ends;
+
+  // merged [first, last] spans of dropped reads, by position
+
+  std::deque< std::pair<long int, long int> > spans;
+
+ public:
+
+  long int nDropped;
+
+  depthSampler(int);
+
+  // false when the read should not be loaded; reads come by position.
+  // Without nameHash the name is decoded and hashed when needed.
+
+  bool keep(BamTools::BamAlignment &, const uint64_t * nameHash = NULL);
+
+  // whether a dropped read overlapped pos
+
+  bool downsampled(long int) const;
+
+  // forgets the spans that end before pos
+
+  void purgeBefore(long int);
+};
+
+#endif
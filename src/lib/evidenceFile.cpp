@@ -0,0 +1,757 @@
+//
+//  evidenceFile.cpp
+//  wham
+//
+
+#include "evidenceFile.h"
+#include "baiIndex.h"
+#include "readNameSet.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+using namespace BamTools;
+
+#define EVIDENCE_MAGIC "WHAMEV2\n"
+#define EVIDENCE_END   "WHAMEVX\n"
+
+// read kinds, the first byte of each read
+
+#define EV_INFORMATIVE 1
+#define EV_SA          2
+#define EV_XA          4
+
+static const char cigarTypes[] = "MIDNSHP=X";
+
+// numbers are little endian, whatever the machine
+
+static void putFixed(string & out, uint64_t v, int bytes){
+  for(int i = 0; i < bytes; i++){
+    out.push_back(char(v & 0xff));
+    v >>= 8;
+  }
+}
+
+static uint64_t getFixed(const char * in, int bytes){
+  uint64_t v = 0;
+  for(int i = bytes - 1; i >= 0; i--){
+    v = (v << 8) | (unsigned char) in[i];
+  }
+  return v;
+}
+
+static void putVarint(string & out, uint64_t v){
+  while(v >= 0x80){
+    out.push_back(char((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(char(v));
+}
+
+// signed values are zigzagged so small negatives stay short
+
+static void putSigned(string & out, int64_t v){
+  putVarint(out, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+static void putString(string & out, const string & s){
+  putVarint(out, s.size());
+  out.append(s);
+}
+
+// the decoders stop at the end of the block; a short block is an error
+
+static bool getVarint(const string & in, size_t & at, uint64_t & v){
+  v = 0;
+  for(int shift = 0; shift < 64 && at < in.size(); shift += 7){
+    unsigned char c = in[at++];
+    v |= uint64_t(c & 0x7f) << shift;
+    if((c & 0x80) == 0){
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool getSigned(const string & in, size_t & at, int64_t & v){
+  uint64_t u;
+  if(! getVarint(in, at, u)){
+    return false;
+  }
+  v = int64_t(u >> 1) ^ -int64_t(u & 1);
+  return true;
+}
+
+static bool getString(const string & in, size_t & at, string & s){
+  uint64_t n;
+  if(! getVarint(in, at, n) || n > in.size() - at){
+    return false;
+  }
+  s.assign(in, at, n);
+  at += n;
+  return true;
+}
+
+static bool writeAll(FILE * fp, const string & s){
+  return s.empty() || fwrite(s.data(), 1, s.size(), fp) == s.size();
+}
+
+static bool readAll(FILE * fp, string & s, size_t n){
+  s.resize(n);
+  return n == 0 || fread(&s[0], 1, n, fp) == n;
+}
+
+evidenceWriter::evidenceWriter(){
+  fp           = NULL;
+  offset       = 0;
+  nReads       = 0;
+  nInformative = 0;
+  nBytes       = 0;
+}
+
+evidenceWriter::~evidenceWriter(){
+  if(fp != NULL){
+    fclose(fp);
+    unlink(tmpPath.c_str());
+  }
+}
+
+bool evidenceWriter::open(const string & fileName, const string & headerText,
+			  const RefVector & refs, const insertStats & stats){
+
+  path = fileName;
+
+  stringstream tmp;
+  tmp << fileName << ".tmp." << getpid();
+  tmpPath = tmp.str();
+
+  fp = fopen(tmpPath.c_str(), "wb");
+  if(fp == NULL){
+    return false;
+  }
+
+  string head(EVIDENCE_MAGIC);
+
+  putFixed(head, refs.size(), 4);
+  for(RefVector::const_iterator it = refs.begin(); it != refs.end(); it++){
+    putFixed(head, it->RefName.size(), 4);
+    head.append(it->RefName);
+    putFixed(head, uint32_t(it->RefLength), 4);
+  }
+
+  putFixed(head, headerText.size(), 4);
+  head.append(headerText);
+
+  stringstream st;
+  writeInsertStats(st, stats);
+
+  putFixed(head, st.str().size(), 4);
+  head.append(st.str());
+
+  offset = head.size();
+
+  block.nReads = 0;
+  raw.clear();
+  index.clear();
+
+  return writeAll(fp, head);
+}
+
+bool evidenceWriter::flush(void){
+
+  if(block.nReads == 0){
+    return true;
+  }
+
+  uLongf size = compressBound(raw.size());
+  string deflated(size, '\0');
+
+  if(compress2((Bytef *) &deflated[0], &size,
+	       (const Bytef *) raw.data(), raw.size(), 6) != Z_OK){
+    return false;
+  }
+  deflated.resize(size);
+
+  block.offset  = offset;
+  block.size    = size;
+  block.rawSize = raw.size();
+
+  index.push_back(block);
+
+  offset += size;
+  nBytes += size;
+
+  raw.clear();
+  block.nReads = 0;
+
+  return writeAll(fp, deflated);
+}
+
+bool evidenceWriter::add(BamAlignment & al, int group, bool informative,
+			 const alignmentTags & tags, const uint64_t * nameHash){
+
+  if(fp == NULL || al.RefID < 0){
+    return false;
+  }
+
+  // the input has to be sorted
+
+  const evidenceBlock * last = block.nReads > 0 ? &block 
+    : (index.empty() ? NULL : &index.back());
+
+  if(last != NULL 
+     && (al.RefID < last->refId 
+	 || (al.RefID == last->refId && al.Position < last->lastPos))){
+    return false;
+  }
+
+  if(block.nReads > 0
+     && (al.RefID != block.refId || raw.size() >= EVIDENCE_BLOCK)){
+    if(! flush()){
+      return false;
+    }
+  }
+
+  int32_t end = al.GetEndPosition(false, false);
+
+  if(block.nReads == 0){
+    block.refId    = al.RefID;
+    block.firstPos = al.Position;
+    block.lastPos  = al.Position;
+    block.maxEnd   = end;
+  }
+
+  unsigned char kind = 0;
+  if(informative){
+    kind |= EV_INFORMATIVE;
+    if(! tags.sa.empty()){
+      kind |= EV_SA;
+    }
+    if(! tags.xa.empty()){
+      kind |= EV_XA;
+    }
+  }
+
+  raw.push_back(char(kind));
+  putVarint(raw, al.Position - block.lastPos);
+  putVarint(raw, al.AlignmentFlag);
+  raw.push_back(char(al.MapQuality));
+  putVarint(raw, al.Length);
+
+  putVarint(raw, al.CigarData.size());
+  for(vector<CigarOp>::const_iterator it = al.CigarData.begin();
+      it != al.CigarData.end(); it++){
+    const char * t = strchr(cigarTypes, it->Type);
+    putVarint(raw, (uint64_t(it->Length) << 4) | (t == NULL ? 0 : t - cigarTypes));
+  }
+
+  putVarint(raw, al.MateRefID + 1);
+  putSigned(raw, int64_t(al.MatePosition) - al.Position);
+  putSigned(raw, al.InsertSize);
+  putVarint(raw, group);
+
+  if(informative){
+    putString(raw, al.Name);
+    putString(raw, al.QueryBases);
+    putString(raw, al.Qualities);
+    if(kind & EV_SA){
+      putString(raw, tags.sa);
+    }
+    if(kind & EV_XA){
+      putString(raw, tags.xa);
+    }
+    nInformative += 1;
+  }
+  else{
+    putFixed(raw, nameHash != NULL ? *nameHash 
+	     : hashReadName(al.Name.data(), al.Name.size()), 8);
+  }
+
+  block.lastPos = al.Position;
+  block.maxEnd  = max(block.maxEnd, end);
+  block.nReads += 1;
+  nReads       += 1;
+
+  return true;
+}
+
+bool evidenceWriter::close(void){
+
+  if(fp == NULL){
+    return false;
+  }
+
+  bool ok = flush();
+
+  string tail;
+
+  putFixed(tail, index.size(), 4);
+  for(vector<evidenceBlock>::iterator it = index.begin();
+      it != index.end(); it++){
+    putFixed(tail, uint32_t(it->refId),    4);
+    putFixed(tail, uint32_t(it->firstPos), 4);
+    putFixed(tail, uint32_t(it->lastPos),  4);
+    putFixed(tail, uint32_t(it->maxEnd),   4);
+    putFixed(tail, it->offset,             8);
+    putFixed(tail, it->nReads,             4);
+    putFixed(tail, it->size,               4);
+    putFixed(tail, it->rawSize,            4);
+  }
+  putFixed(tail, offset, 8);
+  tail.append(EVIDENCE_END);
+
+  ok = ok && writeAll(fp, tail);
+  ok = (fclose(fp) == 0) && ok;
+  fp = NULL;
+
+  if(! ok || rename(tmpPath.c_str(), path.c_str()) != 0){
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+evidenceReader::evidenceReader(){
+  fp = NULL;
+  close();
+}
+
+evidenceReader::~evidenceReader(){
+  close();
+}
+
+bool evidenceReader::isEvidence(const string & fileName){
+
+  FILE * f = fopen(fileName.c_str(), "rb");
+  if(f == NULL){
+    return false;
+  }
+
+  char magic[8];
+  bool is = fread(magic, 1, 8, f) == 8 && memcmp(magic, EVIDENCE_MAGIC, 8) == 0;
+
+  fclose(f);
+  return is;
+}
+
+bool evidenceReader::isOpen(void){
+  return opened;
+}
+
+void evidenceReader::close(void){
+  if(fp != NULL){
+    fclose(fp);
+  }
+  fp       = NULL;
+  opened   = false;
+  keepOpen = true;
+  held.clear();
+  index.clear();
+  reach.clear();
+  refs.clear();
+  header.clear();
+  raw.clear();
+  regionRef = -1;
+  nextBlock = 0;
+  left      = 0;
+}
+
+bool evidenceReader::open(const string & fileName, bool keep){
+
+  close();
+
+  path = fileName;
+  fp   = fopen(fileName.c_str(), "rb");
+
+  if(fp == NULL){
+    error = "cannot open";
+    return false;
+  }
+
+  string buf;
+
+  // the footer first, so a file cut short is caught before anything
+  // is used
+
+  if(fseeko(fp, -16, SEEK_END) != 0 || ! readAll(fp, buf, 16)
+     || buf.compare(8, 8, EVIDENCE_END) != 0){
+    error = "not a complete evidence file";
+    close();
+    return false;
+  }
+
+  uint64_t indexOffset = getFixed(buf.data(), 8);
+
+  if(fseeko(fp, 0, SEEK_SET) != 0 || ! readAll(fp, buf, 12)
+     || buf.compare(0, 8, EVIDENCE_MAGIC) != 0){
+    error = "not an evidence file";
+    close();
+    return false;
+  }
+
+  uint32_t nRefs = getFixed(buf.data() + 8, 4);
+
+  for(uint32_t r = 0; r < nRefs; r++){
+    string name;
+    if(! readAll(fp, buf, 4) || ! readAll(fp, name, getFixed(buf.data(), 4))
+       || ! readAll(fp, buf, 4)){
+      error = "truncated references";
+      close();
+      return false;
+    }
+    refs.push_back(RefData(name, int32_t(getFixed(buf.data(), 4))));
+  }
+
+  string statsText;
+
+  if(! readAll(fp, buf, 4) || ! readAll(fp, header, getFixed(buf.data(), 4))
+     || ! readAll(fp, buf, 4) || ! readAll(fp, statsText, getFixed(buf.data(), 4))){
+    error = "truncated header";
+    close();
+    return false;
+  }
+
+  stringstream st(statsText);
+  if(! readInsertStats(st, stats)){
+    error = "unreadable insert statistics";
+    close();
+    return false;
+  }
+
+  groups = readGroupIndex();
+  groups.addSample(SamHeader(header));
+
+  if(fseeko(fp, indexOffset, SEEK_SET) != 0 || ! readAll(fp, buf, 4)){
+    error = "truncated index";
+    close();
+    return false;
+  }
+
+  uint32_t nBlocks = getFixed(buf.data(), 4);
+
+  if(! readAll(fp, buf, size_t(nBlocks) * 36)){
+    error = "truncated index";
+    close();
+    return false;
+  }
+
+  for(uint32_t b = 0; b < nBlocks; b++){
+    const char *  e = buf.data() + size_t(b) * 36;
+    evidenceBlock block;
+    block.refId    = int32_t(getFixed(e,      4));
+    block.firstPos = int32_t(getFixed(e +  4, 4));
+    block.lastPos  = int32_t(getFixed(e +  8, 4));
+    block.maxEnd   = int32_t(getFixed(e + 12, 4));
+    block.offset   = getFixed(e + 16, 8);
+    block.nReads   = getFixed(e + 24, 4);
+    block.size     = getFixed(e + 28, 4);
+    block.rawSize  = getFixed(e + 32, 4);
+    index.push_back(block);
+
+    int32_t r = block.maxEnd;
+    if(b > 0 && index[b - 1].refId == block.refId){
+      r = max(r, reach[b - 1]);
+    }
+    reach.push_back(r);
+  }
+
+  opened   = true;
+  keepOpen = keep;
+
+  if(! keepOpen){
+    fclose(fp);
+    fp = NULL;
+  }
+
+  return true;
+}
+
+const string & evidenceReader::headerText(void) const {
+  return header;
+}
+
+const RefVector & evidenceReader::references(void) const {
+  return refs;
+}
+
+const insertStats & evidenceReader::libraryStats(void) const {
+  return stats;
+}
+
+// reads in one block and inflates it
+
+bool evidenceReader::load(size_t b){
+
+  const evidenceBlock & block = index[b];
+
+  const char * bytes = NULL;
+
+  if(keepOpen){
+    if(fseeko(fp, block.offset, SEEK_SET) != 0
+       || ! readAll(fp, deflated, block.size)){
+      error = "truncated block";
+      return false;
+    }
+    bytes = deflated.data();
+  }
+  else{
+    if(block.offset < heldFrom 
+       || block.offset - heldFrom + block.size > held.size()){
+      error = "block outside the region read in";
+      return false;
+    }
+    bytes = held.data() + (block.offset - heldFrom);
+  }
+
+  raw.resize(block.rawSize);
+
+  uLongf size = block.rawSize;
+  if(uncompress((Bytef *) &raw[0], &size,
+		(const Bytef *) bytes, block.size) != Z_OK
+     || size != block.rawSize){
+    error = "corrupt block";
+    return false;
+  }
+
+  cursor  = 0;
+  left    = block.nReads;
+  lastPos = block.firstPos;
+
+  return true;
+}
+
+bool evidenceReader::setRegion(int ref, int start, int end){
+
+  left      = 0;
+  regionRef = -1;
+
+  if(! opened || ref < 0 || ref >= (int) refs.size()){
+    return false;
+  }
+
+  regionRef   = ref;
+  regionStart = start;
+  regionEnd   = end;
+
+  // the blocks of a reference are together and their reach only grows,
+  // so the first one reaching past start is found by halving
+
+  size_t lo = 0;
+  size_t hi = index.size();
+
+  while(lo < hi){
+    size_t m = (lo + hi) / 2;
+    if(index[m].refId < ref
+       || (index[m].refId == ref && reach[m] <= start)){
+      lo = m + 1;
+    }
+    else{
+      hi = m;
+    }
+  }
+
+  nextBlock = lo;
+
+  if(keepOpen){
+    return true;
+  }
+
+  // the blocks getNextAlignment will go through, read in at once
+
+  size_t last = nextBlock;
+  while(last < index.size() && index[last].refId == ref 
+	&& index[last].firstPos <= end){
+    last += 1;
+  }
+
+  held.clear();
+
+  if(last == nextBlock){
+    return true;
+  }
+
+  heldFrom = index[nextBlock].offset;
+
+  uint64_t size = index[last - 1].offset + index[last - 1].size - heldFrom;
+
+  fp = fopen(path.c_str(), "rb");
+
+  bool ok = fp != NULL
+    && fseeko(fp, heldFrom, SEEK_SET) == 0
+    && readAll(fp, held, size);
+
+  if(fp != NULL){
+    fclose(fp);
+    fp = NULL;
+  }
+  if(! ok){
+    error     = "cannot read the region";
+    regionRef = -1;
+    return false;
+  }
+  return true;
+}
+
+bool evidenceReader::decode(BamAlignment & al, uint64_t & nameHash){
+
+  uint64_t v;
+  int64_t  s;
+
+  if(cursor >= raw.size()){
+    return false;
+  }
+
+  unsigned char kind = raw[cursor++];
+
+  al = BamAlignment();
+
+  al.RefID = index[nextBlock - 1].refId;
+
+  if(! getVarint(raw, cursor, v)){
+    return false;
+  }
+  al.Position = lastPos + v;
+  lastPos     = al.Position;
+
+  if(! getVarint(raw, cursor, v) || cursor >= raw.size()){
+    return false;
+  }
+  al.AlignmentFlag = v;
+  al.MapQuality    = (unsigned char) raw[cursor++];
+
+  if(! getVarint(raw, cursor, v)){
+    return false;
+  }
+  al.Length = v;
+
+  if(! getVarint(raw, cursor, v)){
+    return false;
+  }
+  for(uint64_t n = v; n > 0; n--){
+    if(! getVarint(raw, cursor, v) || (v & 0xf) >= sizeof(cigarTypes) - 1){
+      return false;
+    }
+    al.CigarData.push_back(CigarOp(cigarTypes[v & 0xf], uint32_t(v >> 4)));
+  }
+
+  if(! getVarint(raw, cursor, v)){
+    return false;
+  }
+  al.MateRefID = int32_t(v) - 1;
+
+  if(! getSigned(raw, cursor, s)){
+    return false;
+  }
+  al.MatePosition = al.Position + s;
+
+  if(! getSigned(raw, cursor, s)){
+    return false;
+  }
+  al.InsertSize = s;
+
+  if(! getVarint(raw, cursor, v)){
+    return false;
+  }
+
+  int g = groups.first(0) + int(v);
+  if(g < groups.nGroups() && ! groups.id(g).empty()){
+    al.AddTag("RG", "Z", groups.id(g));
+  }
+
+  if(! (kind & EV_INFORMATIVE)){
+    if(raw.size() - cursor < 8){
+      return false;
+    }
+    nameHash = getFixed(raw.data() + cursor, 8);
+    cursor  += 8;
+    return true;
+  }
+
+  string tag;
+  if(! getString(raw, cursor, al.Name)
+     || ! getString(raw, cursor, al.QueryBases)
+     || ! getString(raw, cursor, al.Qualities)){
+    return false;
+  }
+  nameHash = hashReadName(al.Name.data(), al.Name.size());
+
+  if(kind & EV_SA){
+    if(! getString(raw, cursor, tag)){
+      return false;
+    }
+    al.AddTag("SA", "Z", tag);
+  }
+  if(kind & EV_XA){
+    if(! getString(raw, cursor, tag)){
+      return false;
+    }
+    al.AddTag("XA", "Z", tag);
+  }
+  return true;
+}
+
+bool evidenceReader::getNextAlignment(BamAlignment & al, uint64_t & nameHash){
+
+  if(regionRef < 0){
+    return false;
+  }
+
+  while(true){
+
+    if(left == 0){
+      if(nextBlock >= index.size()
+	 || index[nextBlock].refId != regionRef
+	 || index[nextBlock].firstPos > regionEnd){
+	regionRef = -1;
+	return false;
+      }
+      if(! load(nextBlock)){
+	regionRef = -1;
+	return false;
+      }
+      nextBlock += 1;
+    }
+
+    if(! decode(al, nameHash)){
+      error     = "corrupt read";
+      regionRef = -1;
+      return false;
+    }
+    left -= 1;
+
+    if(al.Position > regionEnd){
+      regionRef = -1;
+      return false;
+    }
+    if(al.GetEndPosition(false, false) <= regionStart){
+      continue;
+    }
+    return true;
+  }
+}
+
+void evidenceReader::addWindowBytes(int ref, vector<double> & w) const {
+
+  // a block's bytes are spread evenly over the span of its reads
+
+  for(vector<evidenceBlock>::const_iterator it = index.begin();
+      it != index.end(); it++){
+    if(it->refId != ref){
+      continue;
+    }
+    long int first = it->firstPos / BAI_WINDOW;
+    long int last  = it->lastPos  / BAI_WINDOW;
+    if((long int) w.size() <= last){
+      w.resize(last + 1, 0);
+    }
+    double share = double(it->size) / double(last - first + 1);
+    for(long int i = first; i <= last; i++){
+      w[i] += share;
+    }
+  }
+}
@@ -0,0 +1,175 @@
+//
+//  evidenceFile.h
+//  wham
+//
+//  A compact copy of what WHAM-BAM reads from a BAM, written once by
+//  "WHAM-BAM extract" so later runs need not stream the BAM again.  The
+//  file (.wev) holds the BAM's header and references, its insert
+//  statistics, and every read that passes the read filter, in position
+//  order.  Each read keeps the core fields and its read group.  The
+//  reads the pileup decodes (clipped, split, discordant and those with
+//  an odd mate) keep their name, bases, qualities and SA/XA tags; the
+//  rest keep only the 8 byte hashReadName() of their name, which is all
+//  the depth cap looks at.  Reads are varint packed into blocks of about 64 kb that are
+//  deflated on their own, and an index of the blocks at the end lets a
+//  reader jump to a region like a BAM reader does.
+//
+//  Layout: magic; references; header text; insert statistics; blocks;
+//  index (one entry per block); the index offset and an end magic.
+//
+
+#ifndef evidenceFile_h
+#define evidenceFile_h
+
+#include "api/api_global.h"
+#include "api/BamAlignment.h"
+#include "api/BamAux.h"
+
+#include "insertStatsCache.h"
+#include "readGroupIndex.h"
+#include "alignmentTags.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define EVIDENCE_BLOCK 65536  // raw bytes per block, about
+
+// a block holds the reads of one reference
+
+struct evidenceBlock{
+  int32_t  refId   ;
+  int32_t  firstPos;
+  int32_t  lastPos ;  // of the last read start
+  int32_t  maxEnd  ;  // past the end of the longest reaching read
+  uint64_t offset  ;
+  uint32_t nReads  ;
+  uint32_t size    ;  // deflated
+  uint32_t rawSize ;
+};
+
+class evidenceWriter {
+
+ private:
+
+  FILE *                     fp     ;
+  std::string                path   ;
+  std::string                tmpPath;
+  std::string                raw    ;
+  evidenceBlock              block  ;
+  std::vector<evidenceBlock> index  ;
+  uint64_t                   offset ;
+
+  bool flush(void);
+
+ public:
+
+  long int nReads      ;
+  long int nInformative;
+  uint64_t nBytes      ;  // deflated read bytes
+
+  evidenceWriter() ;
+  ~evidenceWriter();
+
+  // the file appears under its name only once close() succeeds
+
+  bool open(const std::string & fileName,
+	    const std::string & headerText,
+	    const BamTools::RefVector & refs,
+	    const insertStats & stats);
+
+  // reads must come in position order; group is the read's group among
+  // those of the header, as readGroupIndex numbers them.  tags are only
+  // kept for an informative read.  nameHash, when given, stands for the
+  // hash of a read that has no name, as one from another evidence file.
+
+  bool add(BamTools::BamAlignment & al,
+	   int group,
+	   bool informative,
+	   const alignmentTags & tags,
+	   const uint64_t * nameHash = NULL);
+
+  bool close(void);
+};
+
+class evidenceReader {
+
+ private:
+
+  FILE *                     fp     ;
+  std::string                path   ;
+  std::string                header ;
+  BamTools::RefVector        refs   ;
+  insertStats                stats  ;
+  readGroupIndex             groups ;
+  std::vector<evidenceBlock> index  ;
+
+  // per block, the furthest any read up to it reaches on its reference
+
+  std::vector<int32_t>       reach  ;
+
+  // without keepOpen the file is closed between regions, and setRegion
+  // reads the region's blocks, which lie together, into held in one go
+
+  bool                       keepOpen;
+  bool                       opened  ;
+  std::string                held    ;
+  uint64_t                   heldFrom;  // file offset of held
+
+  // the region being read
+
+  int      regionRef  ;
+  int      regionStart;
+  int      regionEnd  ;
+  size_t   nextBlock  ;
+  int32_t  lastPos    ;
+  uint32_t left       ;  // reads not yet decoded in the block
+
+  std::string raw     ;
+  std::string deflated;
+  size_t      cursor  ;
+
+  bool load(size_t);
+  bool decode(BamTools::BamAlignment &, uint64_t &);
+
+ public:
+
+  std::string error;
+
+  evidenceReader() ;
+  ~evidenceReader();
+
+  // true when the file starts with the evidence magic
+
+  static bool isEvidence(const std::string &);
+
+  // with keepOpen false the file is only open inside setRegion, so a
+  // pool of many files holds no descriptors between regions
+
+  bool open(const std::string &, bool keepOpen = true);
+  bool isOpen(void);
+  void close(void);
+
+  const std::string &         headerText(void) const;
+  const BamTools::RefVector & references(void) const;
+  const insertStats &         libraryStats(void) const;
+
+  // the reads overlapping [start, end] on the reference, as
+  // BamReader::SetRegion gives them
+
+  bool setRegion(int, int, int);
+
+  // fully decoded: the RG tag on every read, the name, strings and tags
+  // on the informative ones.  nameHash is the hashReadName() of the
+  // name, which the other reads only have in that form.
+
+  bool getNextAlignment(BamTools::BamAlignment &, uint64_t & nameHash);
+
+  // deflated bytes of the reads that start in each window of a
+  // reference, like baiIndex::addWindowBytes
+
+  void addWindowBytes(int, std::vector<double> &) const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+//
+//  glKernel.cpp
+//  wham
+//
+
+#include "glKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// log P(read | genotype) by allele and MAPQ, with the mapping error
+// spread over the genotype's alleles as in the per-read formula.  A
+// MAPQ of zero makes some entries -inf, as it always has.
+
+struct glTables{
+
+  double ll[2][3][GL_MAPQ];  // [allele][genotype][mapq]
+
+  glTables(void){
+    for(int q = 0; q < GL_MAPQ; q++){
+
+      double p        = q;
+      double mappingP = pow(10, (-p/10));
+
+      ll[0][0][q] = log((2 - 2)*mappingP + (2*(1-mappingP)));
+      ll[0][1][q] = log((2 - 1)*mappingP + (1*(1-mappingP)));
+      ll[0][2][q] = log((2 - 0)*mappingP + (0*(1-mappingP)));
+
+      ll[1][0][q] = log((2-2) * (1-mappingP) + (2*mappingP));
+      ll[1][1][q] = log((2-1) * (1-mappingP) + (1*mappingP));
+      ll[1][2][q] = log((2-0) * (1-mappingP) + (0*mappingP));
+    }
+  }
+};
+
+static const glTables tables;
+
+glKernel::glKernel(void){
+  nSamples = 0;
+  qLow     = GL_MAPQ;
+  qHigh    = -1;
+}
+
+void glKernel::reset(int n){
+
+  if(n != nSamples){
+    nSamples = n;
+    counts.assign(2 * GL_MAPQ * n, 0);
+  }
+  else if(qLow <= qHigh){
+    for(int a = 0; a < 2; a++){
+      uint32_t * c = &counts[(a * GL_MAPQ + qLow) * nSamples];
+      fill(c, c + (qHigh - qLow + 1) * nSamples, 0);
+    }
+  }
+  qLow  = GL_MAPQ;
+  qHigh = -1;
+}
+
+void glKernel::add(int sample, int mapQ, bool alt){
+
+  if(mapQ >= GL_MAPQ){
+    mapQ = GL_MAPQ - 1;
+  }
+  if(mapQ < qLow){
+    qLow = mapQ;
+  }
+  if(mapQ > qHigh){
+    qHigh = mapQ;
+  }
+  counts[((alt ? GL_MAPQ : 0) + mapQ) * nSamples + sample] += 1;
+}
+
+void glKernel::likelihoods(vector<double> & gls){
+
+  const int n = nSamples;
+
+  vector<double> aa(n, 0);
+  vector<double> ab(n, 0);
+  vector<double> bb(n, 0);
+
+  for(int a = 0; a < 2; a++){
+    for(int q = qLow; q <= qHigh; q++){
+
+      const uint32_t * c  = &counts[(a * GL_MAPQ + q) * n];
+      const double     t0 = tables.ll[a][0][q];
+      const double     t1 = tables.ll[a][1][q];
+      const double     t2 = tables.ll[a][2][q];
+
+      // zero times -inf would be nan; only samples with reads here
+      // take the -inf
+
+      if(! (std::isfinite(t0) && std::isfinite(t1) && std::isfinite(t2))){
+	for(int s = 0; s < n; s++){
+	  if(c[s] > 0){
+	    aa[s] += c[s] * t0;
+	    ab[s] += c[s] * t1;
+	    bb[s] += c[s] * t2;
+	  }
+	}
+	continue;
+      }
+
+      double * paa = &aa[0];
+      double * pab = &ab[0];
+      double * pbb = &bb[0];
+
+#pragma omp simd
+      for(int s = 0; s < n; s++){
+	paa[s] += c[s] * t0;
+	pab[s] += c[s] * t1;
+	pbb[s] += c[s] * t2;
+      }
+    }
+  }
+
+  gls.resize(3 * n);
+
+  for(int s = 0; s < n; s++){
+    gls[3 * s    ] = aa[s];
+    gls[3 * s + 1] = ab[s];
+    gls[3 * s + 2] = bb[s];
+  }
+}
@@ -0,0 +1,49 @@
+//
+//  glKernel.h
+//  wham
+//
+//  Genotype likelihoods from reads tallied by MAPQ.  Each read adds the
+//  log probability of its allele and MAPQ under 0/0, 0/1 and 1/1, which
+//  only depends on the two, so the reads of every sample are counted per
+//  MAPQ and each table entry is multiplied in once per count.  Counts
+//  of all samples at one MAPQ sit side by side and the innermost loop
+//  runs across samples, so a large cohort fills the vector lanes.
+//
+
+#ifndef glKernel_h
+#define glKernel_h
+
+#include <stdint.h>
+#include <vector>
+
+#define GL_MAPQ 256   // MAPQ values tabled; higher ones are clamped
+
+class glKernel {
+
+ private:
+
+  int nSamples;
+  int qLow    ;  // MAPQ range with any counts
+  int qHigh   ;
+
+  // [allele][mapq][sample]; allele 0 is the reference
+
+  std::vector<uint32_t> counts;
+
+ public:
+
+  glKernel(void);
+
+  // clears the tallies for the next site
+
+  void reset(int);
+
+  void add(int sample, int mapQ, bool alt);
+
+  // gls[3 * sample + g]: the log-likelihoods of 0/0, 0/1 and 1/1,
+  // before the 2^n normalisation
+
+  void likelihoods(std::vector<double> & gls);
+};
+
+#endif
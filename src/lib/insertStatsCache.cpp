@@ -0,0 +1,199 @@
+//
+//  insertStatsCache.cpp
+//  wham
+//
+
+#include "insertStatsCache.h"
+#include "readNameSet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+using namespace std;
+
+#define STATS_VERSION "wham-insert-stats 6"
+
+struct bamIdentity{
+  string    path  ;
+  long long size  ;
+  long long mtime ;
+  string    header;  // checksum, in hex
+};
+
+static bool identify(const string & bam, const string & headerText,
+		     bamIdentity & id){
+
+  struct stat st;
+  if(stat(bam.c_str(), &st) != 0){
+    return false;
+  }
+
+  char full[PATH_MAX];
+  if(realpath(bam.c_str(), full) == NULL){
+    return false;
+  }
+
+  stringstream hs;
+  hs << hex << hashReadName(headerText.data(), headerText.size());
+
+  id.path   = full;
+  id.size   = st.st_size;
+  id.mtime  = st.st_mtime;
+  id.header = hs.str();
+  return true;
+}
+
+string insertStatsPath(const string & bam){
+  return bam + ".wham.stats";
+}
+
+// one "key value" pair per line; the path may hold spaces
+
+static bool field(istream & in, const string & key, string & value){
+
+  string line;
+  if(! getline(in, line)){
+    return false;
+  }
+  if(line.compare(0, key.size() + 1, key + " ") != 0){
+    return false;
+  }
+  value = line.substr(key.size() + 1);
+  return true;
+}
+
+bool readInsertStats(istream & in, insertStats & stats){
+
+  string mu, sd, depth, sdDepth, reads, nGroups;
+
+  if(! field(in, "mean",    mu)
+     || ! field(in, "sd",      sd)
+     || ! field(in, "depth",   depth)
+     || ! field(in, "sdDepth", sdDepth)
+     || ! field(in, "reads",   reads)
+     || ! field(in, "groups",  nGroups)){
+    return false;
+  }
+
+  stats.groups.clear();
+
+  // group lines are tab separated: ID, reads, low and high cutoff
+
+  for(int g = atoi(nGroups.c_str()); g > 0; g--){
+    string value;
+    if(! field(in, "group", value)){
+      return false;
+    }
+    vector<string> cols;
+    stringstream   cs(value);
+    string         col;
+    while(getline(cs, col, '\t')){
+      cols.push_back(col);
+    }
+    if(cols.size() != 4){
+      return false;
+    }
+    groupStats gs;
+    gs.id      = cols[0];
+    gs.nReads  = atol(cols[1].c_str());
+    gs.lowCut  = strtod(cols[2].c_str(), NULL);
+    gs.highCut = strtod(cols[3].c_str(), NULL);
+    stats.groups.push_back(gs);
+  }
+
+  stats.mu     = strtod(mu.c_str(),      NULL);
+  stats.sd     = strtod(sd.c_str(),      NULL);
+  stats.avgD   = strtod(depth.c_str(),   NULL);
+  stats.sdD    = strtod(sdDepth.c_str(), NULL);
+  stats.nReads = atol(reads.c_str());
+
+  return true;
+}
+
+void writeInsertStats(ostream & out, const insertStats & stats){
+
+  // all the digits, so a reused value is the one that was computed
+
+  out << setprecision(17);
+
+  out << "mean "    << stats.mu          << endl;
+  out << "sd "      << stats.sd          << endl;
+  out << "depth "   << stats.avgD        << endl;
+  out << "sdDepth " << stats.sdD         << endl;
+  out << "reads "   << stats.nReads      << endl;
+  out << "groups "  << stats.groups.size() << endl;
+  for(vector<groupStats>::const_iterator it = stats.groups.begin();
+      it != stats.groups.end(); it++){
+    out << "group " << it->id << "\t" << it->nReads 
+	<< "\t" << it->lowCut << "\t" << it->highCut << endl;
+  }
+}
+
+bool loadInsertStats(const string & bam, const string & headerText,
+		     insertStats & stats){
+
+  bamIdentity id;
+  if(! identify(bam, headerText, id)){
+    return false;
+  }
+
+  ifstream in(insertStatsPath(bam).c_str());
+  if(! in.is_open()){
+    return false;
+  }
+
+  string line;
+  if(! getline(in, line) || line != STATS_VERSION){
+    return false;
+  }
+
+  string path, size, mtime, header;
+
+  if(! field(in, "path",   path)   || path   != id.path
+     || ! field(in, "size",   size)   || atoll(size.c_str())  != id.size
+     || ! field(in, "mtime",  mtime)  || atoll(mtime.c_str()) != id.mtime
+     || ! field(in, "header", header) || header != id.header){
+    return false;
+  }
+
+  return readInsertStats(in, stats);
+}
+
+bool saveInsertStats(const string & bam, const string & headerText,
+		     const insertStats & stats){
+
+  bamIdentity id;
+  if(! identify(bam, headerText, id)){
+    return false;
+  }
+
+  // written aside and renamed, so a run reading it never sees half
+
+  stringstream tmp;
+  tmp << insertStatsPath(bam) << ".tmp." << getpid();
+
+  ofstream out(tmp.str().c_str());
+  if(! out.is_open()){
+    return false;
+  }
+
+  out << STATS_VERSION                   << endl;
+  out << "path "    << id.path           << endl;
+  out << "size "    << id.size           << endl;
+  out << "mtime "   << id.mtime          << endl;
+  out << "header "  << id.header         << endl;
+  writeInsertStats(out, stats);
+  out.close();
+
+  if(out.fail() || rename(tmp.str().c_str(), insertStatsPath(bam).c_str()) != 0){
+    unlink(tmp.str().c_str());
+    return false;
+  }
+  return true;
+}
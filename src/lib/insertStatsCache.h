@@ -0,0 +1,61 @@
+//
+//  insertStatsCache.h
+//  wham
+//
+//  The insert length and depth statistics gathered for a BAM at start
+//  up, with the odd-insert cutoffs of each read group, kept in a small
+//  text file next to it (<bam>.wham.stats).  The file records the BAM's
+//  full path, size, modification time and a checksum of its header; a
+//  later run reuses the numbers only when all four still match, so a BAM
+//  that was rewritten samples again.  The sampling does not depend on
+//  --seed (see libraryStats.h), so any run may reuse them.
+//
+
+#ifndef insertStatsCache_h
+#define insertStatsCache_h
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+// the inserts of one read group that are odd: below lowCut or above
+// highCut
+
+struct groupStats{
+  std::string id     ;  // RG ID; empty when the header had no @RG
+  long int    nReads ;
+  double      lowCut ;
+  double      highCut;
+};
+
+struct insertStats{
+  double   mu     ;  // insert length mean
+  double   sd     ;  //   and standard deviation
+  double   avgD   ;  // reads per position
+  double   sdD    ;
+  long int nReads ;  // reads sampled
+  std::vector<groupStats> groups;  // in header order
+};
+
+// the numbers alone, "key value" lines from the mean through the
+// groups; the sidecar and the evidence files both hold them
+
+void writeInsertStats(std::ostream &, const insertStats &);
+bool readInsertStats (std::istream &, insertStats &);
+
+std::string insertStatsPath(const std::string & bam);
+
+// true when the sidecar exists and describes this BAM as it is now
+
+bool loadInsertStats(const std::string & bam,
+		     const std::string & headerText,
+		     insertStats & stats);
+
+// false when the sidecar could not be written, e.g. a read-only
+// directory; the run goes on without it
+
+bool saveInsertStats(const std::string & bam,
+		     const std::string & headerText,
+		     const insertStats & stats);
+
+#endif
@@ -0,0 +1,254 @@
+//
+//  kmerMask.cpp
+//  wham
+//
+
+#include "kmerMask.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// one k-mer per line, as plain decimal numbers
+
+static bool readText(const string & file, vector<uint64_t> & kmers){
+
+  ifstream in(file.c_str(), ios::in | ios::binary);
+
+  if(! in.is_open()){
+    return false;
+  }
+
+  string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+  const char * s   = text.c_str();
+  const char * end = s + text.size();
+
+  long int line = 1;
+
+  while(s < end){
+    if(*s == '\n' || *s == '\r' || *s == ' ' || *s == '\t'){
+      if(*s == '\n'){
+	line += 1;
+      }
+      s++;
+      continue;
+    }
+    if(*s < '0' || *s > '9'){
+      cerr << "FATAL: masking file " << file << " line " << line
+	   << " is not a k-mer" << endl;
+      return false;
+    }
+    char * e;
+    kmers.push_back(strtoull(s, &e, 10));
+    s = e;
+  }
+
+  sort(kmers.begin(), kmers.end());
+  kmers.erase(unique(kmers.begin(), kmers.end()), kmers.end());
+
+  return true;
+}
+
+// an in-order walk of the tree takes the sorted k-mers in turn
+
+static size_t fillTree(const vector<uint64_t> & sorted, vector<uint64_t> & tree,
+		       size_t i, size_t k){
+  if(k < tree.size()){
+    i       = fillTree(sorted, tree, i, 2 * k);
+    tree[k] = sorted[i++];
+    i       = fillTree(sorted, tree, i, 2 * k + 1);
+  }
+  return i;
+}
+
+static void layTree(const vector<uint64_t> & sorted, vector<uint64_t> & tree){
+  tree.assign(sorted.size() + 1, 0);
+  fillTree(sorted, tree, 0, 1);
+}
+
+kmerMask::kmerMask(void){
+  tree        = NULL;
+  n           = 0;
+  length      = 0;
+  mapped      = NULL;
+  mappedBytes = 0;
+}
+
+kmerMask::~kmerMask(){
+  if(mapped != NULL){
+    munmap(mapped, mappedBytes);
+  }
+}
+
+bool kmerMask::build(const string & text, const string & binary, uint32_t kmerLength){
+
+  vector<uint64_t> sorted;
+
+  if(! readText(text, sorted)){
+    return false;
+  }
+
+  vector<uint64_t> layout;
+  layTree(sorted, layout);
+
+  kmerMaskHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, KMER_MASK_MAGIC, 8);
+  header.version    = KMER_MASK_VERSION;
+  header.kmerLength = kmerLength;
+  header.nKmers     = sorted.size();
+
+  ofstream out(binary.c_str(), ios::out | ios::binary | ios::trunc);
+
+  if(! out.is_open()){
+    cerr << "FATAL: could not write: " << binary << endl;
+    return false;
+  }
+
+  out.write((const char *) &header, sizeof(header));
+  out.write((const char *) &layout[0], layout.size() * sizeof(uint64_t));
+
+  if(! out.good()){
+    cerr << "FATAL: could not write: " << binary << endl;
+    return false;
+  }
+
+  out.close();
+
+  cerr << "INFO: wrote " << sorted.size() << " " << kmerLength
+       << "-mers to " << binary << endl;
+
+  return true;
+}
+
+bool kmerMask::loadText(const string & file){
+
+  vector<uint64_t> sorted;
+
+  if(! readText(file, sorted)){
+    return false;
+  }
+
+  layTree(sorted, owned);
+
+  tree = &owned[0];
+  n    = sorted.size();
+
+  return true;
+}
+
+bool kmerMask::loadBinary(const string & file){
+
+  int fd = open(file.c_str(), O_RDONLY);
+
+  if(fd < 0){
+    return false;
+  }
+
+  struct stat st;
+
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(kmerMaskHeader)){
+    close(fd);
+    return false;
+  }
+
+  mappedBytes = st.st_size;
+  mapped      = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+
+  close(fd);
+
+  if(mapped == MAP_FAILED){
+    mapped = NULL;
+    return false;
+  }
+
+  const kmerMaskHeader * header = (const kmerMaskHeader *) mapped;
+
+  if(header->version != KMER_MASK_VERSION){
+    cerr << "FATAL: masking file " << file << " is version " << header->version
+	 << ", this WHAM-BAM reads version " << KMER_MASK_VERSION
+	 << "; rebuild it with WHAM-BAM mask-build" << endl;
+    return false;
+  }
+  if(header->kmerLength != length){
+    cerr << "FATAL: masking file " << file << " holds " << header->kmerLength
+	 << "-mers, WHAM-BAM uses " << length << "-mers" << endl;
+    return false;
+  }
+  if(mappedBytes < sizeof(kmerMaskHeader) + (header->nKmers + 1) * sizeof(uint64_t)){
+    cerr << "FATAL: masking file " << file << " is truncated" << endl;
+    return false;
+  }
+
+  n    = header->nKmers;
+  tree = (const uint64_t *) ((const char *) mapped + sizeof(kmerMaskHeader));
+
+  madvise(mapped, mappedBytes, MADV_WILLNEED);
+
+  return true;
+}
+
+bool kmerMask::load(const string & file, uint32_t kmerLength){
+
+  length = kmerLength;
+
+  char magic[8];
+
+  ifstream in(file.c_str(), ios::in | ios::binary);
+
+  if(! in.is_open()){
+    return false;
+  }
+
+  bool binary = in.read(magic, 8) && memcmp(magic, KMER_MASK_MAGIC, 8) == 0;
+
+  in.close();
+
+  if(binary){
+    return loadBinary(file);
+  }
+
+  cerr << "INFO: masking file is text; WHAM-BAM mask-build makes a binary one that loads faster" << endl;
+
+  return loadText(file);
+}
+
+// walks down the tree: right when the slot is smaller, left otherwise.
+// The walk ends below a leaf; the trailing right turns, plus one left,
+// lead back to the smallest k-mer not below the query.
+
+bool kmerMask::contains(uint64_t kmer) const {
+
+  if(n == 0){
+    return false;
+  }
+
+  uint64_t k = 1;
+
+  while(k <= n){
+    __builtin_prefetch(tree + 16 * k);
+    k = 2 * k + (tree[k] < kmer);
+  }
+
+  k >>= __builtin_ffsll(~k);
+
+  return k != 0 && tree[k] == kmer;
+}
+
+uint64_t kmerMask::size(void) const {
+  return n;
+}
+
+bool kmerMask::empty(void) const {
+  return n == 0;
+}
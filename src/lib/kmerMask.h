@@ -0,0 +1,72 @@
+//
+//  kmerMask.h
+//  wham
+//
+//  The k-mer masking database.  `WHAM-BAM mask-build` turns the text
+//  list of 2-bit packed k-mers into a binary file holding the sorted
+//  k-mers in Eytzinger (breadth-first search tree) order, which WHAM-BAM
+//  maps read-only and shares between the threads.  The top levels of
+//  the tree stay in cache and each step of a lookup prefetches the
+//  cache line holding the next levels.
+//
+//  A text list can still be given to -m; it is sorted into the same
+//  layout in memory.
+//
+
+#ifndef kmerMask_h
+#define kmerMask_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define KMER_MASK_MAGIC   "WHAMKMER"
+#define KMER_MASK_VERSION 1
+
+// the header is one cache line so the tree starts on one
+
+struct kmerMaskHeader{
+  char     magic[8]    ;
+  uint32_t version     ;
+  uint32_t kmerLength  ;
+  uint64_t nKmers      ;
+  uint64_t reserved[5] ;
+};
+
+class kmerMask {
+
+ private:
+
+  // slot 0 is padding, the root is slot 1 and the children of k are
+  // 2k and 2k + 1
+
+  const uint64_t *      tree  ;
+  uint64_t              n     ;
+  uint32_t              length;
+
+  std::vector<uint64_t> owned ;  // the tree when loaded from text
+  void *                mapped;
+  size_t                mappedBytes;
+
+  bool loadText(const std::string &);
+  bool loadBinary(const std::string &);
+
+ public:
+
+  kmerMask(void);
+  ~kmerMask();
+
+  // reads a binary mask or a text list; errors go to cerr
+
+  bool load(const std::string &, uint32_t);
+
+  // reads a text list and writes it as a binary mask
+
+  static bool build(const std::string &, const std::string &, uint32_t);
+
+  bool     contains(uint64_t) const;
+  uint64_t size(void) const;
+  bool     empty(void) const;
+};
+
+#endif
@@ -0,0 +1,314 @@
+//
+//  libraryStats.cpp
+//  wham
+//
+
+#include "libraryStats.h"
+#include "baiIndex.h"
+#include "siteRandom.h"
+
+#include "api/BamReader.h"
+
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+using namespace std;
+using namespace BamTools;
+
+// the relative weight of each reference for drawing windows
+
+static bool referenceWeights(const string & bam, const RefVector & refs,
+			     vector<double> & weights){
+
+  weights.assign(refs.size(), 0);
+
+  baiIndex bai;
+  bool     indexed = bai.load(bam);
+  bool     counted = false;
+
+  if(indexed){
+    for(unsigned int r = 0; r < refs.size() && r < bai.refs.size(); r++){
+      if(bai.refs[r].hasCounts){
+	weights[r] = bai.refs[r].mapped;
+	counted    = true;
+      }
+    }
+    if(! counted){
+      for(unsigned int r = 0; r < refs.size() && r < bai.refs.size(); r++){
+	vector<double> w;
+	bai.addWindowBytes(r, w);
+	for(vector<double>::iterator it = w.begin(); it != w.end(); it++){
+	  weights[r] += (*it);
+	}
+      }
+    }
+  }
+
+  double total = 0;
+  for(unsigned int r = 0; r < refs.size(); r++){
+    total += weights[r];
+  }
+
+  if(total <= 0){
+    for(unsigned int r = 0; r < refs.size(); r++){
+      weights[r] = refs[r].RefLength;
+      total     += weights[r];
+    }
+  }
+  return total > 0;
+}
+
+// whether the 95% intervals of the mean and of the standard deviation
+// are both within their tolerances; the error of the SD allows for the
+// kurtosis, as insert lengths have long tails
+
+static bool converged(const vector<double> & x, double * mu, double * sd){
+
+  double n = x.size();
+
+  double sum = 0;
+  for(vector<double>::const_iterator it = x.begin(); it != x.end(); it++){
+    sum += (*it);
+  }
+  double m = sum / n;
+
+  double m2 = 0;
+  double m4 = 0;
+  for(vector<double>::const_iterator it = x.begin(); it != x.end(); it++){
+    double d  = (*it) - m;
+    double d2 = d * d;
+    m2 += d2;
+    m4 += d2 * d2;
+  }
+  m2 /= n;
+  m4 /= n;
+
+  *mu = m;
+  *sd = sqrt(m2 * n / (n - 1));
+
+  if(m <= 0 || m2 <= 0){
+    return false;
+  }
+
+  double seMean = sqrt(m2 / n);
+  double seSd   = sqrt(max(m4 - m2 * m2, 0.0) / n) / (2 * sqrt(m2));
+
+  return 1.96 * seMean < STATS_MEAN_TOLERANCE * m
+    &&   1.96 * seSd   < STATS_SD_TOLERANCE   * sqrt(m2);
+}
+
+// the odd-insert cutoffs of one group from its histogram
+
+static void groupCutoffs(const vector<uint32_t> & hist, const insertStats & stats,
+			 groupStats & group){
+
+  if(group.nReads < STATS_MIN_GROUP_READS){
+    group.lowCut  = stats.mu - 3.0 * stats.sd;
+    group.highCut = stats.mu + 3.0 * stats.sd;
+    return;
+  }
+
+  double low  = STATS_TAIL         * group.nReads;
+  double high = (1.0 - STATS_TAIL) * group.nReads;
+
+  double cumulative = 0;
+
+  group.lowCut  = -1;
+  group.highCut = STATS_MAX_INSERT;
+
+  for(unsigned int i = 0; i < hist.size(); i++){
+    cumulative += hist[i];
+    if(group.lowCut < 0 && cumulative > low){
+      group.lowCut = i;
+    }
+    if(cumulative >= high){
+      group.highCut = i;
+      break;
+    }
+  }
+}
+
+bool sampleLibrary(const string & bam,
+		   insertStats & stats, long int * nWindows){
+
+  BamReader reader;
+  if(! reader.Open(bam) || ! reader.LocateIndex()){
+    return false;
+  }
+
+  const RefVector & refs = reader.GetReferenceData();
+
+  readGroupIndex groups;
+  groups.addSample(reader.GetHeader());
+
+  vector< vector<uint32_t> > hist(groups.count(0), 
+				  vector<uint32_t>(STATS_MAX_INSERT, 0));
+  vector<long int>           groupReads(groups.count(0), 0);
+
+  string rg;
+
+  vector<double> weights;
+  if(! referenceWeights(bam, refs, weights)){
+    return false;
+  }
+
+  vector<double> cumulative(weights.size(), 0);
+  double total  = 0;
+  double length = 0;
+  for(unsigned int r = 0; r < weights.size(); r++){
+    total        += weights[r];
+    cumulative[r] = total;
+    length       += refs[r].RefLength;
+  }
+
+  // windows are drawn by mapped reads, which suits the inserts, but a
+  // small reference packed with reads (chrM, decoys) would be drawn far
+  // more than its length and pull the depth up.  Each window's depth
+  // is weighted back by its reference's share of the genome over its
+  // share of the draw.
+
+  vector<double> depthWeight(weights.size(), 0);
+  for(unsigned int r = 0; r < weights.size(); r++){
+    if(weights[r] > 0 && length > 0){
+      depthWeight[r] = (refs[r].RefLength / length) / (weights[r] / total);
+    }
+  }
+
+  siteRandom rng;
+  rng.seed(STATS_SEED, reader.GetHeaderText(), 0);
+
+  vector<double> inserts;
+  double         depthSum = 0;
+  double         depthSq  = 0;
+  double         nDepth   = 0;  // the sum of the window weights
+  size_t         checked  = 0;
+
+  stats.mu   = 0;
+  stats.sd   = 0;
+  *nWindows  = 0;
+
+  BamAlignment al;
+
+  // ends of the sampled reads over the current position
+
+  priority_queue<long int, vector<long int>, greater<long int> > ends;
+
+  while(inserts.size() < STATS_MAX_READS && *nWindows < STATS_MAX_WINDOWS){
+
+    double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * total;
+    int    r = upper_bound(cumulative.begin(), cumulative.end(), u)
+      - cumulative.begin();
+    if(r >= (int) refs.size()){
+      r = refs.size() - 1;
+    }
+
+    int length = refs[r].RefLength;
+    int start  = 0;
+    if(length > STATS_WINDOW){
+      start = rng.below(length - STATS_WINDOW);
+    }
+    int end = min(start + STATS_WINDOW, length);
+
+    *nWindows += 1;
+
+    if(! reader.SetRegion(r, start, r, end)){
+      continue;
+    }
+
+    while(! ends.empty()){
+      ends.pop();
+    }
+
+    long int cp = -1;
+
+    // the window's own moments, so a dense window counts once like a
+    // sparse one
+
+    double   windowSum = 0;
+    double   windowSq  = 0;
+    long int windowN   = 0;
+
+    while(reader.GetNextAlignmentCore(al)){
+      if(! al.IsMapped()
+	 || ! al.IsMateMapped()
+	 || abs(double(al.InsertSize)) >= STATS_MAX_INSERT
+	 || al.RefID != al.MateRefID){
+	continue;
+      }
+
+      // the depth at each new read start, once the reads from before
+      // the window are all in
+
+      if(al.Position > cp){
+	while(! ends.empty() && ends.top() < al.Position){
+	  ends.pop();
+	}
+	if(al.Position >= start){
+	  windowSum += ends.size();
+	  windowSq  += double(ends.size()) * ends.size();
+	  windowN   += 1;
+	}
+	cp = al.Position;
+      }
+      ends.push(al.GetEndPosition(false, true));
+      inserts.push_back(abs(double(al.InsertSize)));
+
+      int g = 0;
+      if(groups.multiple(0)){
+	al.BuildCharData();
+	if(! al.GetTag("RG", rg)){
+	  rg.clear();
+	}
+	g = groups.group(0, rg);
+      }
+      hist[g][abs(al.InsertSize)] += 1;
+      groupReads[g] += 1;
+    }
+
+    if(windowN > 0){
+      depthSum += depthWeight[r] * windowSum / windowN;
+      depthSq  += depthWeight[r] * windowSq  / windowN;
+      nDepth   += depthWeight[r];
+    }
+
+    // the intervals are only checked as the sample grows by a tenth
+
+    if(*nWindows >= STATS_MIN_WINDOWS
+       && inserts.size() >= STATS_MIN_READS
+       && inserts.size() >= checked + checked / 10){
+      checked = inserts.size();
+      if(converged(inserts, &stats.mu, &stats.sd)){
+	break;
+      }
+    }
+  }
+
+  if(inserts.size() > 1){
+    converged(inserts, &stats.mu, &stats.sd);
+  }
+
+  stats.nReads = inserts.size();
+  stats.avgD   = 0;
+  stats.sdD    = 0;
+
+  if(nDepth > 0){
+    stats.avgD = depthSum / nDepth;
+    stats.sdD  = sqrt(max(depthSq / nDepth - stats.avgD * stats.avgD, 0.0));
+  }
+
+  stats.groups.clear();
+
+  for(int g = 0; g < groups.count(0); g++){
+    groupStats gs;
+    gs.id     = groups.id(g);
+    gs.nReads = groupReads[g];
+    groupCutoffs(hist[g], stats, gs);
+    stats.groups.push_back(gs);
+  }
+
+  reader.Close();
+  return true;
+}
@@ -0,0 +1,54 @@
+//
+//  libraryStats.h
+//  wham
+//
+//  The insert length and depth of one BAM, estimated from random
+//  windows.  Windows are spread over every reference in proportion to
+//  its mapped reads in the index (its indexed bytes, or its length, when
+//  the index has no counts) and read through one reader that only jumps
+//  between them.  The depth is weighted back to each reference's length,
+//  so a short reference dense with reads, like chrM, does not inflate it.
+//  Sampling stops once the 95% intervals of the insert mean and standard
+//  deviation are within a set fraction of the estimates, so a
+//  well-behaved library costs a few windows.  The SD interval widens
+//  with every outlier, so it is held to less.
+//
+//  Each read group gets a histogram of its inserts, and its odd-insert
+//  cutoffs are the STATS_TAIL and 1 - STATS_TAIL quantiles, the points
+//  3 SD out on a normal curve.  A BAM holding several libraries is then
+//  not judged by their blend.  A group with too few reads sampled falls
+//  back to the mean plus or minus 3 SD of the whole BAM.
+//
+
+#ifndef libraryStats_h
+#define libraryStats_h
+
+#include "insertStatsCache.h"
+#include "readGroupIndex.h"
+
+#include <string>
+
+#define STATS_WINDOW       10000   // bp
+#define STATS_MIN_WINDOWS      3
+#define STATS_MIN_READS     2000
+#define STATS_MAX_READS    50000   // a heavy tailed library stops here
+#define STATS_MAX_WINDOWS  20000   // and one with few pairs here
+#define STATS_MEAN_TOLERANCE 0.01
+#define STATS_SD_TOLERANCE   0.05
+#define STATS_MAX_READERS      8   // BAMs sampled at once
+#define STATS_MAX_INSERT   10000   // longer inserts are not sampled
+#define STATS_TAIL       0.00135
+#define STATS_MIN_GROUP_READS 1000
+#define STATS_SEED     0x77686d73   // not --seed: the sidecar outlives a run
+
+// false when the BAM or its index cannot be opened; the windows drawn
+// are reported through nWindows.  stats.groups follows the header, as
+// readGroupIndex numbers the groups.  The windows are drawn from
+// STATS_SEED and the BAM's header, so a BAM gives the same numbers in
+// every run, and a copy of it the same as the original.
+
+bool sampleLibrary(const std::string & bam,
+		   insertStats & stats,
+		   long int * nWindows);
+
+#endif
@@ -0,0 +1,198 @@
+//
+//  microAssembler.cpp
+//  wham
+//
+
+#include "microAssembler.h"
+#include "KMERUTILS.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static const uint64_t KMER_BITS = 2 * ASSEMBLY_K;
+static const uint64_t KMER_ALL  = (uint64_t(1) << KMER_BITS) - 1;
+static const uint32_t SLOTS     = uint32_t(1) << ASSEMBLY_TABLE_BITS;
+
+static inline uint32_t slotOf(uint64_t kmer){
+  kmer ^= kmer >> 29;
+  kmer *= 0xbf58476d1ce4e5b9ULL;
+  kmer ^= kmer >> 32;
+  return kmer & (SLOTS - 1);
+}
+
+microAssembler::microAssembler(void){
+  keys.assign(SLOTS, 0);
+  counts.assign(SLOTS, 0);
+  visited.assign(SLOTS, 0);
+  nReads = 0;
+  walk   = 0;
+}
+
+void microAssembler::clear(void){
+  for(vector<uint32_t>::iterator it = used.begin(); it != used.end(); it++){
+    keys[*it]    = 0;
+    counts[*it]  = 0;
+    visited[*it] = 0;
+  }
+  used.clear();
+  junctions.clear();
+  nReads = 0;
+}
+
+uint32_t microAssembler::size(void) const {
+  return nReads;
+}
+
+int64_t microAssembler::find(uint64_t kmer) const {
+  uint32_t s = slotOf(kmer);
+  while(keys[s] != 0){
+    if(keys[s] == kmer + 1){
+      return s;
+    }
+    s = (s + 1) & (SLOTS - 1);
+  }
+  return -1;
+}
+
+uint32_t microAssembler::count(uint64_t kmer) const {
+  int64_t s = find(kmer);
+  return s < 0 ? 0 : counts[s];
+}
+
+bool microAssembler::addRead(const char * seq, uint32_t length, int32_t junction){
+
+  if(nReads >= ASSEMBLY_MAX_READS){
+    return false;
+  }
+
+  nReads += 1;
+
+  if(length < ASSEMBLY_K){
+    return true;
+  }
+
+  kmers.resize(length);
+
+  uint32_t n = rollingKmers(seq, length, ASSEMBLY_K, false, &kmers[0]);
+
+  for(uint32_t i = 0; i < n; i++){
+
+    uint32_t s = slotOf(kmers[i]);
+
+    while(keys[s] != 0 && keys[s] != kmers[i] + 1){
+      s = (s + 1) & (SLOTS - 1);
+    }
+    if(keys[s] == 0){
+      if(used.size() >= SLOTS / 2){
+	continue;
+      }
+      keys[s] = kmers[i] + 1;
+      used.push_back(s);
+    }
+    counts[s] += 1;
+  }
+
+  // the k-mers holding the last clipped base and the first aligned
+  // one; a read with an N there adds none
+
+  if(junction > 0 && junction < (int32_t) length){
+    int32_t first = max(0, junction - ASSEMBLY_K + 1);
+    int32_t last  = min(junction - 1, (int32_t) length - ASSEMBLY_K);
+    for(int32_t start = first; start <= last; start++){
+      uint64_t kmer = 0;
+      if(rollingKmers(seq + start, ASSEMBLY_K, ASSEMBLY_K, false, &kmer) == 1){
+	junctions.push_back(kmer);
+      }
+    }
+  }
+
+  return true;
+}
+
+// follows the heaviest neighbour, one base at a time, until the
+// neighbours are too rare, the walk comes back on itself or limit bases
+// were added
+
+bool microAssembler::extend(uint64_t seed, bool right, uint32_t limit, string & bases){
+
+  uint64_t kmer = seed;
+
+  while(bases.size() < limit){
+
+    uint64_t next = 0;
+    uint32_t most = 0;
+    int      base = -1;
+
+    for(uint64_t c = 0; c < 4; c++){
+      uint64_t candidate = right
+	? (((kmer << 2) | c) & KMER_ALL)
+	: ((kmer >> 2) | (c << (KMER_BITS - 2)));
+      uint32_t n = count(candidate);
+      if(n > most){
+	most = n;
+	next = candidate;
+	base = c;
+      }
+    }
+
+    if(most < ASSEMBLY_MIN_COUNT){
+      break;
+    }
+
+    int64_t s = find(next);
+    if(visited[s] == walk){
+      break;
+    }
+    visited[s] = walk;
+
+    bases += dna_lookup[base];
+    kmer   = next;
+  }
+  return true;
+}
+
+bool microAssembler::assemble(string & contig){
+
+  contig.clear();
+
+  uint64_t seed = 0;
+  uint32_t most = 0;
+
+  for(vector<uint64_t>::iterator it = junctions.begin();
+      it != junctions.end(); it++){
+    uint32_t n = count(*it);
+    if(n > most || (n == most && *it < seed)){
+      most = n;
+      seed = *it;
+    }
+  }
+
+  if(most < ASSEMBLY_MIN_COUNT){
+    return false;
+  }
+
+  walk += 1;
+
+  int64_t s = find(seed);
+  visited[s] = walk;
+
+  string right;
+  string left;
+
+  extend(seed, true,  ASSEMBLY_MAX_CONTIG - ASSEMBLY_K, right);
+  extend(seed, false, ASSEMBLY_MAX_CONTIG - ASSEMBLY_K - right.size(), left);
+
+  char kmer[ASSEMBLY_K + 1];
+  for(int i = ASSEMBLY_K - 1; i >= 0; i--){
+    kmer[i] = dna_lookup[(seed >> (2 * (ASSEMBLY_K - 1 - i))) & 3];
+  }
+  kmer[ASSEMBLY_K] = '\0';
+
+  contig.reserve(left.size() + ASSEMBLY_K + right.size());
+  contig.assign(left.rbegin(), left.rend());
+  contig += kmer;
+  contig += right;
+
+  return true;
+}
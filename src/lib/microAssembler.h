@@ -0,0 +1,69 @@
+//
+//  microAssembler.h
+//  wham
+//
+//  A small de Bruijn assembler for the reads clipped or split at one
+//  breakpoint.  The k-mers of the reads are counted and the contig is
+//  the heaviest walk out of the most common k-mer spanning the clip
+//  junction, first to the right and then to the left.
+//
+//  Each thread keeps one assembler and reuses its tables from site to
+//  site; the reads, k-mers and contig length per site are capped so a
+//  deep site costs no more than a full one.
+//
+
+#ifndef microAssembler_h
+#define microAssembler_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define ASSEMBLY_K          21
+#define ASSEMBLY_MIN_COUNT   2      // k-mers seen less often are errors
+#define ASSEMBLY_MAX_READS 200
+#define ASSEMBLY_TABLE_BITS 15      // k-mer slots; at most half are used
+#define ASSEMBLY_MAX_CONTIG 1000
+
+class microAssembler {
+
+ private:
+
+  // open addressing on the packed k-mer plus one, so zero is empty
+
+  std::vector<uint64_t> keys   ;
+  std::vector<uint32_t> counts ;
+  std::vector<uint32_t> visited;  // the walk a k-mer was last used in
+  std::vector<uint32_t> used   ;  // slots to empty for the next site
+
+  std::vector<uint64_t> kmers    ;  // scratch for one read
+  std::vector<uint64_t> junctions;  // k-mers spanning a clip junction
+
+  uint32_t nReads;
+  uint32_t walk  ;
+
+  int64_t  find(uint64_t) const;
+  uint32_t count(uint64_t) const;
+  bool     extend(uint64_t, bool, uint32_t, std::string &);
+
+ public:
+
+  microAssembler(void);
+
+  // starts a new site
+
+  void clear(void);
+
+  // adds the bases of a read; junction is the offset of the first base
+  // after the clip boundary, or -1.  False once the site is full.
+
+  bool addRead(const char *, uint32_t, int32_t);
+
+  uint32_t size(void) const;
+
+  // the contig, empty when no junction k-mer was seen often enough
+
+  bool assemble(std::string &);
+};
+
+#endif
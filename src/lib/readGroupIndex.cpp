@@ -0,0 +1,75 @@
+//
+//  readGroupIndex.cpp
+//  wham
+//
+
+#include "readGroupIndex.h"
+
+using namespace std;
+using namespace BamTools;
+
+readGroupIndex::readGroupIndex(void){
+  firstGroup.push_back(0);
+}
+
+void readGroupIndex::addSample(const SamHeader & header){
+
+  int sample = byId.size();
+
+  byId.push_back(unordered_map<string, int>());
+
+  for(SamReadGroupDictionary::ConstIterator it = header.ReadGroups.ConstBegin();
+      it != header.ReadGroups.ConstEnd(); it++){
+    if(byId[sample].find(it->ID) != byId[sample].end()){
+      continue;
+    }
+    byId[sample][it->ID] = ids.size();
+    ids.push_back(it->ID);
+    samples.push_back(sample);
+  }
+
+  if(byId[sample].empty()){
+    ids.push_back("");
+    samples.push_back(sample);
+  }
+
+  firstGroup.push_back(ids.size());
+}
+
+int readGroupIndex::nGroups(void) const {
+  return ids.size();
+}
+
+int readGroupIndex::nSamples(void) const {
+  return byId.size();
+}
+
+int readGroupIndex::first(int sample) const {
+  return firstGroup[sample];
+}
+
+int readGroupIndex::count(int sample) const {
+  return firstGroup[sample + 1] - firstGroup[sample];
+}
+
+bool readGroupIndex::multiple(int sample) const {
+  return count(sample) > 1;
+}
+
+int readGroupIndex::group(int sample, const string & rg) const {
+
+  unordered_map<string, int>::const_iterator it = byId[sample].find(rg);
+
+  if(it == byId[sample].end()){
+    return firstGroup[sample];
+  }
+  return it->second;
+}
+
+const string & readGroupIndex::id(int group) const {
+  return ids[group];
+}
+
+int readGroupIndex::sample(int group) const {
+  return samples[group];
+}
@@ -0,0 +1,58 @@
+//
+//  readGroupIndex.h
+//  wham
+//
+//  Dense numbers for the read groups of every sample, interned once from
+//  the @RG lines of each BAM header.  The groups of a sample are
+//  numbered consecutively and a sample whose header has no @RG lines has
+//  a single group; reads with a missing or unknown RG tag fall in their
+//  sample's first group.  Per-group tables are then plain arrays indexed
+//  by the number stored on each read.
+//
+
+#ifndef readGroupIndex_h
+#define readGroupIndex_h
+
+#include  "api/SamHeader.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+class readGroupIndex {
+
+ private:
+
+  std::vector<int>         firstGroup;  // per sample, and one past the last
+  std::vector<std::string> ids       ;  // per group; empty when the header had none
+  std::vector<int>         samples   ;  // per group
+
+  std::vector< std::unordered_map<std::string, int> > byId;  // per sample
+
+ public:
+
+  readGroupIndex(void);
+
+  // samples are added in order
+
+  void addSample(const BamTools::SamHeader &);
+
+  int nGroups (void) const;
+  int nSamples(void) const;
+
+  int first(int sample) const;
+  int count(int sample) const;
+
+  // reads only need their RG tag looked up when this is true
+
+  bool multiple(int sample) const;
+
+  // the group of a read from its RG tag
+
+  int group(int sample, const std::string & rg) const;
+
+  const std::string & id(int group) const;
+  int sample(int group) const;
+};
+
+#endif
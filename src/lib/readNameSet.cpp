@@ -0,0 +1,169 @@
+//
+//  readNameSet.cpp
+//  wham
+//
+
+#include "readNameSet.h"
+
+#include <string.h>
+
+using namespace std;
+
+uint64_t hashReadName(const char * name, uint32_t length){
+
+  uint64_t h = 14695981039346656037ULL;
+
+  for(uint32_t i = 0; i < length; i++){
+    h ^= (unsigned char) name[i];
+    h *= 1099511628211ULL;
+  }
+  if(h == 0){
+    h = 1;
+  }
+  return h;
+}
+
+readNameSet::readNameSet(){
+  slot empty = {0, 0, 0, 0};
+  slots.assign(256, empty);
+  mask      = 255;
+  nNames    = 0;
+  liveBytes = 0;
+}
+
+// the slot holding the name, or the empty slot it would go in
+
+size_t readNameSet::find(uint64_t hash, const char * name, uint32_t length) const {
+
+  size_t i = hash & mask;
+
+  while(slots[i].hash != 0){
+    if(slots[i].hash == hash
+       && slots[i].length == length
+       && memcmp(pool.data() + slots[i].offset, name, length) == 0){
+      return i;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+// rebuilds the table at the given size; the pool is rewritten with
+// only the live names
+
+void readNameSet::rehash(size_t n){
+
+  vector<slot> old;
+  vector<char> oldPool;
+
+  old.swap(slots);
+  oldPool.swap(pool);
+
+  slot empty = {0, 0, 0, 0};
+  slots.assign(n, empty);
+  mask = n - 1;
+  pool.reserve(liveBytes);
+
+  for(vector<slot>::iterator it = old.begin(); it != old.end(); it++){
+    if((*it).hash == 0){
+      continue;
+    }
+    size_t i = (*it).hash & mask;
+    while(slots[i].hash != 0){
+      i = (i + 1) & mask;
+    }
+    slots[i]        = *it;
+    slots[i].offset = pool.size();
+    pool.insert(pool.end(),
+		oldPool.begin() + (*it).offset,
+		oldPool.begin() + (*it).offset + (*it).length);
+  }
+}
+
+void readNameSet::add(uint64_t hash, const char * name, uint32_t length){
+
+  if((nNames + 1) * 2 > slots.size()){
+    rehash(slots.size() * 2);
+  }
+
+  size_t i = find(hash, name, length);
+
+  if(slots[i].hash != 0){
+    slots[i].count += 1;
+    return;
+  }
+
+  slots[i].hash   = hash;
+  slots[i].offset = pool.size();
+  slots[i].length = length;
+  slots[i].count  = 1;
+  pool.insert(pool.end(), name, name + length);
+
+  nNames    += 1;
+  liveBytes += length;
+}
+
+// linear probing with backward-shift deletion, so no tombstones are left
+
+void readNameSet::remove(uint64_t hash, const char * name, uint32_t length){
+
+  size_t i = find(hash, name, length);
+
+  if(slots[i].hash == 0){
+    return;
+  }
+
+  slots[i].count -= 1;
+  if(slots[i].count > 0){
+    return;
+  }
+
+  nNames    -= 1;
+  liveBytes -= slots[i].length;
+
+  size_t j = i;
+
+  while(true){
+    j = (j + 1) & mask;
+    if(slots[j].hash == 0){
+      break;
+    }
+    size_t home = slots[j].hash & mask;
+    // an entry whose home lies cyclically in (i, j] has to stay put
+    if(i <= j ? (i < home && home <= j) : (i < home || home <= j)){
+      continue;
+    }
+    slots[i] = slots[j];
+    i = j;
+  }
+  slots[i].hash = 0;
+
+  if(nNames == 0){
+    pool.clear();
+  }
+  else if(pool.size() > (1 << 20) && pool.size() > 4 * liveBytes){
+    rehash(slots.size());
+  }
+}
+
+bool readNameSet::contains(uint64_t hash, const char * name, uint32_t length) const {
+  if(nNames == 0){
+    return false;
+  }
+  return slots[find(hash, name, length)].hash != 0;
+}
+
+size_t readNameSet::size(void) const {
+  return nNames;
+}
+
+void readNameSet::clear(void){
+  if(nNames == 0){
+    return;
+  }
+  slot empty = {0, 0, 0, 0};
+  slots.assign(slots.size(), empty);
+  pool.clear();
+  nNames    = 0;
+  liveBytes = 0;
+}
@@ -0,0 +1,57 @@
+//
+//  readNameSet.h
+//  wham
+//
+//  A counted set of read names over one flat open-addressing table.
+//  Names are looked up by a 64-bit fingerprint computed once when the
+//  read is loaded; the bytes are only compared when two fingerprints
+//  agree, so a collision can never merge two names.
+//
+
+#ifndef readNameSet_h
+#define readNameSet_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// FNV-1a; never returns 0, which marks an empty slot
+
+uint64_t hashReadName(const char *, uint32_t);
+
+class readNameSet {
+
+ private:
+
+  struct slot{
+    uint64_t hash  ;
+    uint32_t offset;  // name bytes in pool
+    uint32_t length;
+    int32_t  count ;
+  };
+
+  std::vector<slot> slots;
+  std::vector<char> pool ;
+  size_t  mask    ;
+  size_t  nNames  ;
+  size_t  liveBytes;
+
+  size_t find(uint64_t, const char *, uint32_t) const;
+  void   rehash(size_t);
+
+ public:
+
+  readNameSet();
+
+  // add and remove adjust a per-name count; the name stays in the set
+  // until every add has been matched by a remove
+
+  void add   (uint64_t, const char *, uint32_t);
+  void remove(uint64_t, const char *, uint32_t);
+  bool contains(uint64_t, const char *, uint32_t) const;
+
+  size_t size(void) const;
+  void   clear(void);
+};
+
+#endif
@@ -7,222 +7,204 @@
 //
 
 #include "readPileUp.h"
+#include <iostream>
+#include <algorithm>
+#include <functional>
 
 using namespace std;
 using namespace BamTools;
 
-bool sameStrand(BamAlignment & al){
+bool sameStrand(whamRead & al){
 
-  if(( al.IsReverseStrand() && al.IsMateReverseStrand() ) 
-     || ( ! al.IsReverseStrand() && ! al.IsMateReverseStrand() )){
+  if(( al.isReverseStrand() && al.isMateReverseStrand() ) 
+     || ( ! al.isReverseStrand() && ! al.isMateReverseStrand() )){
     return true;
   }
   return false;
 }
 
-bool readPileUp::processDiscordant(BamAlignment & al, string & saTag){
+bool readPileUp::processDiscordant(whamRead & al, bool hasSa, int w){
 
-  nDiscordant++;
+  nDiscordant += w;
 
-  if(!al.IsMateMapped()){
-    nMatesMissing++;
-    odd[al.Name] = 1;
-    clusterFrontOrBackPrimary(al, true, saTag);
+  if(!al.isMateMapped()){
+    nMatesMissing += w;
+    markOdd(al, w);
+    clusterFrontOrBackPrimary(al, true, hasSa, w);
     return true;
   }
 
-  if(al.RefID != al.MateRefID){
-    nCrossChr++;
-    ndiscordantCrossChr++; 
+  if(al.refId != al.mateRefId){
+    nCrossChr += w;
+    ndiscordantCrossChr += w; 
  }
   
   if(sameStrand(al)){
-    nSameStrand += 1;
-    odd[al.Name] = 1;
+    nSameStrand += w;
+    markOdd(al, w);
   }
   
   if(sameStrand(al)){
-    nsameStrandDiscordant++;
+    nsameStrandDiscordant += w;
   }
 
-  odd[al.Name] = 1;
+  markOdd(al, w);
   
-  clusterFrontOrBackPrimary(al, true, saTag);
+  clusterFrontOrBackPrimary(al, true, hasSa, w);
 
   return true;
 
 }
 
-bool readPileUp::processSplitRead(BamAlignment & al, string & saTag){
+bool readPileUp::processSplitRead(whamRead & al, bool hasSa, int w){
 
-  vector<string> sas = split(saTag, ";");
+  // reads with more than one other alignment are left alone
 
-  if(sas.size() > 2){
+  if(al.nSa != 1){
     return true;
   }
 
-  odd[al.Name] = 1;
-  nsplitRead  += 1;
+  otherAlignment & other = saEntries(al)[0];
 
-  if(al.IsProperPair()){
-    nPaired++;
+  markOdd(al, w);
+  nsplitRead  += w;
+
+  if(al.isProperPair()){
+    nPaired += w;
   }
   else{
-    nDiscordant++;
+    nDiscordant += w;
   }
 
-  vector<string> saData = split(sas[0], ",");
-  
   // checking if the two splitread fragments
   // are on the same strand
 
-  if(saData[2].compare("+") == 0){
-    if(!al.IsReverseStrand() ){
-      nf1f2SameStrand += 1;
+  if(other.strand == '+'){
+    if(!al.isReverseStrand() ){
+      nf1f2SameStrand += w;
     }
   }
   else{
-    if(al.IsReverseStrand() ){
-      nf1f2SameStrand++;
+    if(al.isReverseStrand() ){
+      nf1f2SameStrand += w;
     }
   }
   
   // checking fragment 1 and fragment 2 
   // vs the mate pair
 
-  if(al.IsMateMapped()){
+  if(al.isMateMapped()){
     
     // checking the first fragment 
     // against the mate pair
 
     if(sameStrand(al)){
-      nf1SameStrand++;
+      nf1SameStrand += w;
     }
 
     // checking the second fragment
     // against the mate pair
 
-    if(saData[2].compare("+") == 0){
-      if(!al.IsReverseStrand()){
-	nf2SameStrand++;
+    if(other.strand == '+'){
+      if(!al.isReverseStrand()){
+	nf2SameStrand += w;
       }
     }
     else{
-      nsplitMissingMates++;
+      nsplitMissingMates += w;
     }
     
     // splitread translocation 
 
-    if(al.RefID != al.MateRefID){
-      nsplitReadCrossChr++;
+    if(al.refId != al.mateRefId){
+      nsplitReadCrossChr += w;
     }
   }
 
-  clusterFrontOrBackPrimary(al, false, saTag);
+  clusterFrontOrBackPrimary(al, false, hasSa, w);
   
   return true;
   
 }
 
 
-bool readPileUp::processMissingMate(BamAlignment & al, string & saTag){
+bool readPileUp::processMissingMate(whamRead & al, bool hasSa, int w){
 
-  nMatesMissing++;
+  nMatesMissing += w;
 
-  clusterFrontOrBackPrimary(al, true, saTag);
+  clusterFrontOrBackPrimary(al, true, hasSa, w);
 
-  odd[al.Name] = 1;
+  markOdd(al, w);
 
   return true;
 
 }
 
-bool readPileUp::processPair(BamAlignment & al, string & saTag){
+bool readPileUp::processPair(whamRead & al, bool hasSa, int w){
 
-  nPaired++;
+  nPaired += w;
 
-  if(al.IsMateMapped()){
-    if(al.RefID != al.MateRefID){
-      nCrossChr++;
-      odd[al.Name] = 1;
+  if(al.isMateMapped()){
+    if(al.refId != al.mateRefId){
+      nCrossChr += w;
+      markOdd(al, w);
     }
     else if(sameStrand(al)){
-      nSameStrand += 1;
-      odd[al.Name] = 1;
+      nSameStrand += w;
+      markOdd(al, w);
     }
-    else if(al.IsReverseStrand() 
-	    && ! al.IsMateReverseStrand() 
-	    && al.Position < al.MatePosition){
-      evert++;
+    else if(al.isReverseStrand() 
+	    && ! al.isMateReverseStrand() 
+	    && al.position < al.matePosition){
+      evert += w;
     }
-    else if(! al.IsReverseStrand()
-	    && al.IsMateReverseStrand()
-	    && al.Position > al.MatePosition){
-      evert++;
+    else if(! al.isReverseStrand()
+	    && al.isMateReverseStrand()
+	    && al.position > al.matePosition){
+      evert += w;
     }
   }
   
-  clusterFrontOrBackPrimary(al, true, saTag);
-
-  vector< CigarOp > cd = al.CigarData;
+  clusterFrontOrBackPrimary(al, true, hasSa, w);
 
-  for(vector< CigarOp >::iterator cig = cd.begin(); 
-      cig != cd.end(); cig++){
-
-    switch((*cig).Type){
-    case 'I':
-      {
-	if((*cig).Length > 25){
-	  internalInsertion += 1;
-	  odd[al.Name] = 1;
-	}
-	break;
-      }
-    case 'D':
-      {
-	if((*cig).Length > 25){
-	  internalDeletion += 1;
-	  odd[al.Name] = 1;
-	}
-	break;
-      }
-    default:
-      {
-      }
-    }
+  if(al.nLongIns > 0){
+    internalInsertion += w * al.nLongIns;
+    markOdd(al, w);
+  }
+  if(al.nLongDel > 0){
+    internalDeletion += w * al.nLongDel;
+    markOdd(al, w);
   }
   
   return true;
 }
 
 
-bool readPileUp::clusterFrontOrBackPrimary(BamAlignment & al, bool p, string & saTag){
+bool readPileUp::clusterFrontOrBackPrimary(whamRead & al, bool p, bool hasSa, int w){
 
-  vector< CigarOp > cd = al.CigarData;  
-
-  if((al.AlignmentFlag & 0x0800) != 0){
-    if(cd.front().Type == 'H'){
-      supplement[al.Position].push_back(al);
+  if(al.isSupplementary()){
+    if(al.frontType == 'H'){
+      cluster(supplement, al.position, al, w);
     }
-    if(cd.back().Type == 'H'){
-      supplement[al.GetEndPosition(false,true)].push_back(al);
+    if(al.backType == 'H'){
+      cluster(supplement, al.end, al, w);
     }
   }
   else{
-    if(cd.front().Type == 'S'){
-      nClippedFront++;
-      primary[al.Position].push_back(al);
-      odd[al.Name] = 1;
-      if(! saTag.empty()){
-	supplement[al.Position].push_back(al);
+    if(al.frontType == 'S'){
+      nClippedFront += w;
+      cluster(primary, al.position, al, w);
+      markOdd(al, w);
+      if(hasSa){
+	cluster(supplement, al.position, al, w);
       }
     }
-    if(cd.back().Type == 'S'){
-      nClippedBack++;
-      primary[al.GetEndPosition(false,true)].push_back(al);
-      odd[al.Name] = 1;
-      if(! saTag.empty()){
-	supplement[al.GetEndPosition(false,true)].push_back(al);
+    if(al.backType == 'S'){
+      nClippedBack += w;
+      cluster(primary, al.end, al, w);
+      markOdd(al, w);
+      if(hasSa){
+	cluster(supplement, al.end, al, w);
       }
     }
   }
@@ -230,64 +212,202 @@ bool readPileUp::clusterFrontOrBackPrimary(BamAlignment & al, bool p, string & s
 }
 
 void readPileUp::printPileUp(void){
-  for(list<BamAlignment>::iterator r = currentData.begin();
-      r != currentData.end(); r++){
-    cerr << (*r).Name 
+  for(size_t i = 0; i < currentData.size(); i++){
+    whamRead & r = currentData[i];
+    cerr << strings.str(r.name) 
 	 << "\t"
-	 << (*r).Position
+	 << r.position
 	 << "\t"
-	 << (*r).QueryBases
+	 << strings.str(r.bases)
 	 << endl;
   }
 
 }
 
-void readPileUp::processPileup(long int * pos){
+// adds (w = 1) or removes (w = -1) one read's share of the window
+// statistics and clusters; removal replays exactly what adding did
+
+void readPileUp::tally(whamRead & r, int w){
+
+  mapQsum += w * r.mapQ ;
+
+  numberOfReads += w;
+
+  if(r.mapQ < 50){
+    nLowMapQ += w;
+  }
+    
+  if(! r.isMateMapped()){
+    nMatesMissing += w;
+  }
 
+  bool hasSa = r.sa.length > 0;
+
+  // split reads
+  if(hasSa){
+    processSplitRead(r, hasSa, w);
+    return;
+  }
+   
+  // paired end data
+  if(r.isPaired()){
+    if(!r.isProperPair()){
+      nDiscordant += w;
+    }
+    processPair(r, hasSa, w);
+    return;
+  }
+    
+#ifdef DEBUG
+  if(w > 0){
+    cerr << "Bleed through: " << strings.str(r.name) << endl;
+  }
+#endif
+}
+
+// true for the reads tally() hands to clusterFrontOrBackPrimary as
+// soft clipped primaries
+
+bool readPileUp::clustersPrimary(whamRead & r){
+  if(r.isSupplementary()){
+    return false;
+  }
+  if(r.sa.length > 0){
+    return r.nSa == 1;
+  }
+  return r.isPaired();
+}
+
+void readPileUp::markOdd(whamRead & al, int w){
+  if(w > 0){
+    odd.add(al.nameHash, strings.at(al.name), al.name.length);
+  }
+  else{
+    odd.remove(al.nameHash, strings.at(al.name), al.name.length);
+  }
+}
+
+// true when any read in the window with this name was flagged
+
+bool readPileUp::isOdd(whamRead & al){
+  return odd.contains(al.nameHash, strings.at(al.name), al.name.length);
+}
+
+void readPileUp::cluster(clusterIndex & clusters, long int key, 
+			 whamRead & al, int w){
+  if(w > 0){
+    clusters.add(key, al.serial);
+  }
+  else{
+    clusters.remove(key, al.serial);
+  }
+}
+
+// takes the reads that end before pos out of the window
+
+void readPileUp::retire(long int pos){
+
+  while(! active.empty() && active.front().first < pos){
+    pop_heap(active.begin(), active.end(), greater< pair<long int, uint32_t> >());
+    tally(currentData[active.back().second - frontSerial], -1);
+    active.pop_back();
+  }
+}
+
+// forgets the window; the next processPileup rebuilds it from the queue
+
+void readPileUp::resetWindow(void){
   clearClusters();
   clearStats();
+  active.clear();
+  nSeen     = 0;
+  windowPos = -1;
+}
+
+// brings the statistics and clusters to the reads overlapping pos.  The
+// window only moves right, so each read is added once, when pos reaches
+// its start, and removed once, when pos passes its end.
+
+void readPileUp::processPileup(long int * pos){
+
+  if(*pos < windowPos){
+    resetWindow();
+  }
+
+  windowPos    = *pos;
+  mateTooClose = 0;
+  mateTooFar   = 0;
+
+  retire(*pos);
 
-  for(list<BamAlignment>::iterator r = currentData.begin(); 
-      r != currentData.end(); r++){
+  while(nSeen < currentData.size()){
+
+    whamRead & r = currentData[nSeen];
 
     // trailing pileup data
-    if((*r).Position > *pos){
+    if(r.position > *pos){
+      break;
+    }
+
+    nSeen += 1;
+
+    // ended, but still queued behind a longer read
+    if(r.end < *pos){
       continue;
     }
 
-    mapQsum += (*r).MapQuality ;
+    tally(r, 1);
+
+    active.push_back(make_pair((long int)r.end, r.serial));
+    push_heap(active.begin(), active.end(), greater< pair<long int, uint32_t> >());
+  }
+}
+
+whamRead & readPileUp::read(uint32_t serial){
+  return currentData[serial - frontSerial];
+}
+
+int readPileUp::clippedBetween(long int first, long int last, 
+			       bool front, bool back,
+			       vector<uint32_t> & serials){
+
+  serials.clear();
+
+  int nEnds = 0;
 
-    numberOfReads += 1;
+  for(size_t i = 0; i < currentData.size(); i++){
 
-    if((*r).MapQuality < 50){
-      nLowMapQ += 1;
+    whamRead & r = currentData[i];
+
+    if(r.position > last){
+      break;
     }
-    
-    if(! (*r).IsMateMapped()){
-      nMatesMissing += 1;
+    if(r.end < first || ! clustersPrimary(r)){
+      continue;
     }
 
-    string saTag;   
-    // split reads
-    if( (*r).GetTag("SA", saTag ) ){
-      processSplitRead(*r, saTag);
-      continue;
+    int n = 0;
+
+    if(front && r.frontType == 'S' && r.position >= first){
+      n += 1;
     }
-   
-    // paired end data
-    if((*r).IsPaired()){
-      if(!(*r).IsProperPair()){
-	nDiscordant++;
-      }
-      processPair(*r, saTag);
-      continue;
+    if(back && r.backType == 'S' && r.end <= last){
+      n += 1;
+    }
+    if(n > 0){
+      serials.push_back(r.serial);
+      nEnds += n;
     }
-    
-#ifdef DEBUG
-    cerr << "Bleed through: " << (*r).Name << endl;
-#endif
-    
   }
+  return nEnds;
+}
+
+otherAlignment * readPileUp::saEntries(whamRead & r){
+  return others.data() + r.otherFirst;
+}
+
+otherAlignment * readPileUp::xaEntries(whamRead & r){
+  return others.data() + r.otherFirst + r.nSa;
 }
 
 void readPileUp::clearClusters(void){
@@ -327,39 +447,173 @@ void readPileUp::clearStats(void){
 readPileUp::readPileUp(){
   CurrentPos   = 0;
   CurrentStart = 0;
+  stringBytes  = 0;
+  nOthers      = 0;
+  nextSerial   = 0;
+  frontSerial  = 0;
+  resetWindow();
 }
 
 readPileUp::~readPileUp(){}
 
-void readPileUp::processAlignment(BamTools::BamAlignment Current_alignment){
-  currentData.push_back(Current_alignment);
-  CurrentStart    = Current_alignment.Position;
+// copies the fields the scorer uses into a compact record; strings and
+// tags are only kept for reads that were decoded
+
+void readPileUp::processAlignment(BamTools::BamAlignment & al, int sample,
+				  int readGroup){
+  scratchTags.load(al);
+  processAlignment(al, sample, readGroup, scratchTags);
+}
+
+void readPileUp::processAlignment(BamTools::BamAlignment & al, int sample, 
+				  int readGroup, alignmentTags & tags){
+
+  whamRead r;
+
+  r.position     = al.Position;
+  r.end          = al.GetEndPosition(false,true);
+  r.refId        = al.RefID;
+  r.mateRefId    = al.MateRefID;
+  r.matePosition = al.MatePosition;
+  r.insertSize   = al.InsertSize;
+  r.flag         = al.AlignmentFlag;
+  r.mapQ         = al.MapQuality;
+  r.sample       = sample;
+  r.readGroup    = readGroup;
+  r.length       = al.QueryBases.empty() ? al.Length : al.QueryBases.size();
+  r.frontType    = al.CigarData.front().Type;
+  r.frontLength  = al.CigarData.front().Length;
+  r.backType     = al.CigarData.back().Type;
+  r.backLength   = al.CigarData.back().Length;
+  r.nLongIns     = 0;
+  r.nLongDel     = 0;
+  r.serial       = nextSerial;
+
+  for(vector< CigarOp >::iterator cig = al.CigarData.begin(); 
+      cig != al.CigarData.end(); cig++){
+    if((*cig).Length > 25){
+      if((*cig).Type == 'I'){
+	r.nLongIns += 1;
+      }
+      if((*cig).Type == 'D'){
+	r.nLongDel += 1;
+      }
+    }
+  }
+
+  r.name     = strings.add(al.Name);
+  r.nameHash = hashReadName(al.Name.data(), al.Name.size());
+  r.bases    = strings.add(al.QueryBases);
+  r.quals.offset = 0;
+  r.quals.length = 0;
+  if((r.frontType == 'S' || r.backType == 'S')
+     && al.Qualities.size() == al.QueryBases.size()){
+    r.quals  = strings.add(al.Qualities);
+  }
+  r.sa       = strings.add(tags.sa);
+  r.xa       = strings.add(tags.xa);
+
+  r.otherFirst = others.size();
+  r.nSa        = min(tags.nSa, MAX_TAG_ENTRIES);
+  r.nXa        = min(tags.nXa, MAX_TAG_ENTRIES);
+
+  for(int i = 0; i < r.nSa; i++){
+    others.push_back(tags.saEntries[i]);
+    others.back().seqid.offset += r.sa.offset;
+  }
+  for(int i = 0; i < r.nXa; i++){
+    others.push_back(tags.xaEntries[i]);
+    others.back().seqid.offset += r.xa.offset;
+  }
+  nOthers += r.nSa + r.nXa;
+
+  stringBytes += r.stringBytes();
+
+  currentData.push_back(r);
+  nextSerial += 1;
+  CurrentStart    = al.Position;
 }
 
 void readPileUp::purgeAll(void){
   currentData.clear();
+  strings.clear();
+  stringBytes = 0;
+  others.clear();
+  nOthers     = 0;
+  frontSerial = nextSerial;
+  resetWindow();
 }
 
+// drops the reads that end before delPos from the front of the queue;
+// a read that ends early but sits behind a longer one goes once the
+// longer one does
+
 void readPileUp::purgePast(long int * delPos){
-  
-  int nreads  = currentData.size();
-  int counter = 0;
-  
-  while (!currentData.empty()) {
-    
-    BamAlignment read = currentData.front();
-    currentData.pop_front();    
 
-    if( read.GetEndPosition(false,true) >= *delPos){ 
-      currentData.push_back(read);
-    } 
-   
-    counter += 1;
-    
-    if(counter == nreads){
-      break;
+  CurrentPos = *delPos;
+
+  // the window has to let go of a read before the queue does
+
+  if(*delPos >= windowPos){
+    retire(*delPos);
+  }
+  else{
+    resetWindow();
+  }
+
+  while(! currentData.empty() && currentData.front().end < *delPos){
+    stringBytes -= currentData.front().stringBytes();
+    nOthers     -= currentData.front().nSa + currentData.front().nXa;
+    currentData.pop_front();
+    frontSerial += 1;
+    if(nSeen > 0){
+      nSeen -= 1;
+    }
+  }
+
+  if(currentData.empty()){
+    strings.clear();
+    others.clear();
+  }
+  else if(strings.size() > (1 << 22) && strings.size() > 4 * (size_t)stringBytes){
+    compactStrings();
+  }
+}
+
+// rewrites the string arena, and the parsed tag entries, with only
+// those of queued reads
+
+void readPileUp::compactStrings(void){
+
+  stringArena            live;
+  vector<otherAlignment> liveOthers;
+
+  liveOthers.reserve(nOthers);
+
+  for(size_t i = 0; i < currentData.size(); i++){
+    whamRead & r = currentData[i];
+
+    int32_t saShift = - (int32_t) r.sa.offset;
+    int32_t xaShift = - (int32_t) r.xa.offset;
+
+    r.name  = live.add(strings.at(r.name),  r.name.length );
+    r.bases = live.add(strings.at(r.bases), r.bases.length);
+    r.quals = live.add(strings.at(r.quals), r.quals.length);
+    r.sa    = live.add(strings.at(r.sa),    r.sa.length   );
+    r.xa    = live.add(strings.at(r.xa),    r.xa.length   );
+
+    saShift += r.sa.offset;
+    xaShift += r.xa.offset;
+
+    uint32_t first = liveOthers.size();
+    for(int o = 0; o < r.nSa + r.nXa; o++){
+      liveOthers.push_back(others[r.otherFirst + o]);
+      liveOthers.back().seqid.offset += (o < r.nSa) ? saShift : xaShift;
     }
+    r.otherFirst = first;
   }
+  strings.swap(live);
+  others.swap(liveOthers);
 }
 
 int readPileUp::currentPos(void){
@@ -370,6 +624,14 @@ int readPileUp::currentStart(void){
   return CurrentStart;
 }
 
+// reads that reach the last purge position
+
 int readPileUp::nReads(void){
-  return currentData.size();
+  int n = 0;
+  for(size_t i = 0; i < currentData.size(); i++){
+    if(currentData[i].end >= CurrentPos){
+      n += 1;
+    }
+  }
+  return n;
 }
@@ -12,8 +12,12 @@
 #include  "api/api_global.h"
 #include  "api/BamReader.h"
 #include  "split.h"
+#include  "whamRead.h"
+#include  "ringBuffer.h"
+#include  "readNameSet.h"
+#include  "clusterIndex.h"
+#include  "alignmentTags.h"
 
-#include <list>
 #include <map>
 #include <vector>
 
@@ -24,11 +28,37 @@ class readPileUp {
   int  CurrentId;
   long int  CurrentPos;
   long int  CurrentStart;
-  std::list <BamTools::BamAlignment> currentData;
 
-  std::map <std::string, int> odd;
-  std::map <long int, std::vector<BamTools::BamAlignment> > primary    ;
-  std::map <long int, std::vector<BamTools::BamAlignment> > supplement ;
+  // reads in the order they were added (by position); a read can stay
+  // queued behind a longer one after it ends, so consumers skip reads
+  // that end before the position they look at
+
+  ringBuffer<whamRead> currentData;
+  stringArena          strings    ;
+  long int             stringBytes;
+
+  // parsed SA and XA entries of queued reads, kept like the strings
+
+  std::vector<otherAlignment> others;
+  long int                    nOthers;
+  alignmentTags               scratchTags;
+
+  // the statistics, clusters and odd read names below describe the
+  // reads overlapping windowPos; they are updated as reads enter and
+  // leave rather than rebuilt for every position
+
+  long int  windowPos  ;
+  size_t    nSeen      ;  // queued reads already added to or passed by the window
+  uint32_t  nextSerial ;
+  uint32_t  frontSerial;  // serial of currentData.front()
+
+  // (end, serial) min-heap of the reads in the window
+
+  std::vector< std::pair<long int, uint32_t> > active;
+
+  readNameSet odd;  // names of reads flagged in the window
+  clusterIndex primary   ;  // soft clipped primary reads by breakpoint
+  clusterIndex supplement;  // hard clipped and split reads by breakpoint
 
   int nLowMapQ     ;
   int numberOfReads;
@@ -67,15 +97,44 @@ class readPileUp {
   readPileUp() ;
   ~readPileUp();
 
-  bool clusterFrontOrBackPrimary(BamTools::BamAlignment &, bool, std::string&);
-  bool processSplitRead(BamTools::BamAlignment &, std::string&);
-  bool processDiscordant(BamTools::BamAlignment &, std::string&);
-  bool processSupplement(BamTools::BamAlignment &, std::string&);
-  bool processMissingMate(BamTools::BamAlignment &, std::string&);
-  bool processPair(BamTools::BamAlignment &, std::string&);
+  // the int is 1 when a read enters the window and -1 when it leaves;
+  // hasSa is true for a read with an SA tag
 
-  void processAlignment( BamTools::BamAlignment);
+  bool clusterFrontOrBackPrimary(whamRead &, bool, bool hasSa, int);
+  bool processSplitRead(whamRead &, bool hasSa, int);
+  bool processDiscordant(whamRead &, bool hasSa, int);
+  bool processSupplement(whamRead &, bool hasSa, int);
+  bool processMissingMate(whamRead &, bool hasSa, int);
+  bool processPair(whamRead &, bool hasSa, int);
+  bool clustersPrimary(whamRead &);
+  void tally(whamRead &, int);
+  void markOdd(whamRead &, int);
+  bool isOdd(whamRead &);
+  void cluster(clusterIndex &, long int, whamRead &, int);
+  void retire(long int);
+  void resetWindow(void);
+
+  // the ints are the bam (its index in all) and the read group
+
+  void processAlignment(BamTools::BamAlignment &, int, int, alignmentTags &);
+  void processAlignment(BamTools::BamAlignment &, int, int);
   void processPileup(long int *);
+
+  // a queued read by serial, for following cluster handles
+
+  whamRead & read(uint32_t);
+
+  // the queued reads the primary clusters would hold with a front
+  // and/or back clip in [first, last], in queue order, whether or not
+  // the window has reached or let go of them; returns the number of
+  // clipped ends
+
+  int clippedBetween(long int, long int, bool, bool, std::vector<uint32_t> &);
+
+  otherAlignment * saEntries(whamRead &);
+  otherAlignment * xaEntries(whamRead &);
+
+  void compactStrings(void);
   void printPileUp(void);
   void purgeAll(void);
   void purgePast(long int *);
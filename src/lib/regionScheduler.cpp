@@ -0,0 +1,272 @@
+//
+//  regionScheduler.cpp
+//  wham
+//
+
+#include "regionScheduler.h"
+#include "bamPool.h"
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+regionScheduler::regionScheduler(int n, long int split, double seconds){
+
+  for(int t = 0; t < n; t++){
+    worker * w = new worker;
+    w->queued      = 0;
+    w->running     = false;
+    w->pos         = 0;
+    w->started     = 0;
+    w->busySeconds = 0;
+    w->nRegions    = 0;
+    w->nStolen     = 0;
+    w->nSplit      = 0;
+    omp_init_lock(&w->lock);
+    workers.push_back(w);
+  }
+
+  omp_init_lock(&countLock);
+
+  nOutstanding = 0;
+  minSplit     = split;
+  minSeconds   = seconds;
+}
+
+regionScheduler::~regionScheduler(){
+  for(vector<worker *>::iterator it = workers.begin();
+      it != workers.end(); it++){
+    omp_destroy_lock(&(*it)->lock);
+    delete (*it);
+  }
+  omp_destroy_lock(&countLock);
+}
+
+int regionScheduler::nThreads(void){
+  return workers.size();
+}
+
+void regionScheduler::add(int t, regionTask & task){
+
+  worker * w = workers[t % workers.size()];
+
+  omp_set_lock(&w->lock);
+  w->queue.push_back(task);
+  w->queued += task.weight;
+  omp_unset_lock(&w->lock);
+
+  omp_set_lock(&countLock);
+  nOutstanding += 1;
+  omp_unset_lock(&countLock);
+}
+
+// called with the thread's own lock held
+
+void regionScheduler::start(int t, regionTask & task){
+  worker * w = workers[t];
+  w->running  = true;
+  w->current  = task;
+  w->pos      = task.start;
+  w->started  = bamPool::wallTime();
+}
+
+// takes the last region of the queue holding the most work
+
+bool regionScheduler::steal(int t, regionTask & task){
+
+  while(true){
+
+    int    victim = -1;
+    double most   = 0;
+
+    for(unsigned int v = 0; v < workers.size(); v++){
+      if((int) v == t){
+	continue;
+      }
+      omp_set_lock(&workers[v]->lock);
+      if(! workers[v]->queue.empty() && workers[v]->queued >= most){
+	most   = workers[v]->queued;
+	victim = v;
+      }
+      omp_unset_lock(&workers[v]->lock);
+    }
+    if(victim == -1){
+      return false;
+    }
+
+    worker * w = workers[victim];
+
+    bool got = false;
+
+    omp_set_lock(&w->lock);
+    if(! w->queue.empty()){
+      task = w->queue.back();
+      w->queue.pop_back();
+      w->queued -= task.weight;
+      got = true;
+    }
+    omp_unset_lock(&w->lock);
+
+    if(got){
+      return true;
+    }
+  }
+}
+
+// pulls in the end of the running region with the most ground left and
+// takes the far half; the runner only ever scores positions before its
+// end, and its end never moves behind the last position it reported
+
+bool regionScheduler::split(int t, regionTask & task){
+
+  double now = bamPool::wallTime();
+
+  int      victim = -1;
+  long int most   = 0;
+
+  for(unsigned int v = 0; v < workers.size(); v++){
+    if((int) v == t){
+      continue;
+    }
+    worker * w = workers[v];
+    omp_set_lock(&w->lock);
+    long int left = w->current.end - w->pos;
+    if(w->running && now - w->started >= minSeconds
+       && left >= 2 * minSplit && left > most){
+      most   = left;
+      victim = v;
+    }
+    omp_unset_lock(&w->lock);
+  }
+  if(victim == -1){
+    return false;
+  }
+
+  worker * w = workers[victim];
+
+  bool got = false;
+
+  omp_set_lock(&w->lock);
+  long int left = w->current.end - w->pos;
+  if(w->running && left >= 2 * minSplit){
+    long int mid = w->pos + left / 2;
+
+    task.seqidIndex = w->current.seqidIndex;
+    task.ordinal    = w->current.ordinal;
+    task.start      = mid;
+    task.end        = w->current.end;
+    task.weight     = w->current.weight * double(task.end - mid)
+      / double(w->current.end - w->current.start);
+
+    w->current.weight -= task.weight;
+    w->current.end     = mid;
+    got = true;
+  }
+  omp_unset_lock(&w->lock);
+
+  if(got){
+    omp_set_lock(&countLock);
+    nOutstanding += 1;
+    omp_unset_lock(&countLock);
+  }
+  return got;
+}
+
+bool regionScheduler::next(int t, regionTask & task){
+
+  worker * self = workers[t];
+
+  while(true){
+
+    omp_set_lock(&self->lock);
+    if(! self->queue.empty()){
+      task = self->queue.front();
+      self->queue.pop_front();
+      self->queued -= task.weight;
+      start(t, task);
+      omp_unset_lock(&self->lock);
+      return true;
+    }
+    omp_unset_lock(&self->lock);
+
+    if(steal(t, task)){
+      omp_set_lock(&self->lock);
+      start(t, task);
+      self->nStolen += 1;
+      omp_unset_lock(&self->lock);
+      return true;
+    }
+
+    if(split(t, task)){
+      omp_set_lock(&self->lock);
+      start(t, task);
+      self->nSplit += 1;
+      omp_unset_lock(&self->lock);
+      return true;
+    }
+
+    omp_set_lock(&countLock);
+    long int left = nOutstanding;
+    omp_unset_lock(&countLock);
+
+    if(left == 0){
+      return false;
+    }
+
+    // everything left is running and too small to split yet
+
+    usleep(20000);
+  }
+}
+
+bool regionScheduler::keepGoing(int t, long int pos){
+
+  worker * w = workers[t];
+
+  omp_set_lock(&w->lock);
+  bool go = pos < w->current.end;
+  if(go && pos > w->pos){
+    w->pos = pos;
+  }
+  omp_unset_lock(&w->lock);
+
+  return go;
+}
+
+void regionScheduler::done(int t, regionTask & task){
+
+  worker * w = workers[t];
+
+  omp_set_lock(&w->lock);
+  task            = w->current;
+  w->running      = false;
+  w->busySeconds += bamPool::wallTime() - w->started;
+  w->nRegions    += 1;
+  omp_unset_lock(&w->lock);
+
+  omp_set_lock(&countLock);
+  nOutstanding -= 1;
+  omp_unset_lock(&countLock);
+}
+
+void regionScheduler::report(void){
+
+  double most = 0;
+  double sum  = 0;
+
+  for(unsigned int t = 0; t < workers.size(); t++){
+    worker * w = workers[t];
+    cerr << "INFO: thread " << t << " busy " << w->busySeconds
+	 << " seconds over " << w->nRegions << " regions ("
+	 << w->nStolen << " stolen, " << w->nSplit << " split off)" << endl;
+    sum += w->busySeconds;
+    if(w->busySeconds > most){
+      most = w->busySeconds;
+    }
+  }
+  if(most > 0){
+    cerr << "INFO: thread load balance (mean / max busy time): "
+	 << sum / double(workers.size()) / most << endl;
+  }
+}
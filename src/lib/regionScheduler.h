@@ -0,0 +1,88 @@
+//
+//  regionScheduler.h
+//  wham
+//
+//  Hands genomic regions to the OpenMP threads.  Every thread owns a
+//  queue of regions and takes from its front; a thread whose queue is
+//  empty steals from the back of the fullest queue, and when nothing is
+//  queued it splits the region another thread is still working through
+//  and takes the far half.
+//
+
+#ifndef regionScheduler_h
+#define regionScheduler_h
+
+#include <omp.h>
+#include <deque>
+#include <vector>
+
+struct regionTask{
+  int      seqidIndex;
+  long int start     ;
+  long int end       ;
+  double   weight    ;  // expected work, for picking whom to rob
+  int      ordinal   ;  // genomic order of the region it was cut from
+};
+
+class regionScheduler {
+
+ private:
+
+  struct worker{
+    std::deque<regionTask> queue   ;
+    double                 queued  ;  // weight in the queue
+    omp_lock_t             lock    ;
+
+    // the region being run; end can be pulled in by a split
+
+    bool       running     ;
+    regionTask current     ;
+    long int   pos         ;  // last position the runner reported
+    double     started     ;
+
+    double     busySeconds ;
+    long int   nRegions    ;
+    long int   nStolen     ;
+    long int   nSplit      ;  // regions this thread split off others
+  };
+
+  std::vector<worker *> workers;
+
+  omp_lock_t countLock;
+  long int   nOutstanding;    // regions queued or running
+
+  long int   minSplit   ;     // neither half of a split is shorter
+  double     minSeconds ;     // a region must run this long to be split
+
+  bool steal(int, regionTask &);
+  bool split(int, regionTask &);
+  void start(int, regionTask &);
+
+ public:
+
+  regionScheduler(int, long int, double);
+  ~regionScheduler();
+
+  // before the run; regions go to the given thread's queue
+
+  void add(int, regionTask &);
+
+  // the next region for a thread; false once every region is done
+
+  bool next(int, regionTask &);
+
+  // called by the runner before each position it scores; false once
+  // the position is past the end of its region, which a split may
+  // have moved
+
+  bool keepGoing(int, long int);
+
+  // the region as it finished, with any end a split pulled in
+
+  void done(int, regionTask &);
+
+  int  nThreads(void);
+  void report(void);
+};
+
+#endif
@@ -0,0 +1,79 @@
+//
+//  ringBuffer.h
+//  wham
+//
+//  A growable FIFO over one power-of-two array.  Pushing and popping
+//  never allocate once the buffer has reached its working size.
+//
+
+#ifndef ringBuffer_h
+#define ringBuffer_h
+
+#include <vector>
+#include <stddef.h>
+
+template <typename T>
+class ringBuffer {
+
+ private:
+
+  std::vector<T> data;
+  size_t head ;
+  size_t count;
+  size_t mask ;
+
+  void grow(void){
+    std::vector<T> bigger(data.size() * 2);
+    for(size_t i = 0; i < count; i++){
+      bigger[i] = data[(head + i) & mask];
+    }
+    data.swap(bigger);
+    head = 0;
+    mask = data.size() - 1;
+  }
+
+ public:
+
+  ringBuffer() : data(64), head(0), count(0), mask(63) {}
+
+  size_t size(void) const {
+    return count;
+  }
+
+  bool empty(void) const {
+    return count == 0;
+  }
+
+  // logical index, zero being the oldest element
+  T & operator[](size_t i){
+    return data[(head + i) & mask];
+  }
+
+  T & front(void){
+    return data[head];
+  }
+
+  T & back(void){
+    return data[(head + count - 1) & mask];
+  }
+
+  void push_back(const T & v){
+    if(count == data.size()){
+      grow();
+    }
+    data[(head + count) & mask] = v;
+    count += 1;
+  }
+
+  void pop_front(void){
+    head   = (head + 1) & mask;
+    count -= 1;
+  }
+
+  void clear(void){
+    head  = 0;
+    count = 0;
+  }
+};
+
+#endif
@@ -0,0 +1,50 @@
+//
+//  siteRandom.cpp
+//  wham
+//
+
+#include "siteRandom.h"
+
+using namespace std;
+
+// splitmix64 finaliser; spreads nearby seeds over the whole state
+
+static uint64_t mix(uint64_t z){
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+siteRandom::siteRandom(void){
+  state = mix(1);
+}
+
+void siteRandom::seed(uint64_t runSeed, const string & name, int64_t pos){
+
+  // FNV-1a over the name
+
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for(string::const_iterator it = name.begin(); it != name.end(); it++){
+    h ^= (unsigned char)(*it);
+    h *= 0x100000001b3ULL;
+  }
+
+  state = mix(mix(runSeed) ^ mix(h) ^ mix((uint64_t) pos + 0x9e3779b97f4a7c15ULL));
+
+  // xorshift has a fixed point at zero
+
+  if(state == 0){
+    state = 0x9e3779b97f4a7c15ULL;
+  }
+}
+
+uint64_t siteRandom::next(void){
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dULL;
+}
+
+uint32_t siteRandom::below(uint32_t n){
+  return (uint32_t)(((next() >> 32) * (uint64_t) n) >> 32);
+}
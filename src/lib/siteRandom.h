@@ -0,0 +1,36 @@
+//
+//  siteRandom.h
+//  wham
+//
+//  A small xorshift generator each thread keeps for itself.  It is
+//  reseeded from the run seed and the thing being sampled (a site, a
+//  file), so the draws do not depend on which thread gets the work or
+//  in what order, and a run given the same --seed gives the same calls.
+//
+
+#ifndef siteRandom_h
+#define siteRandom_h
+
+#include <stdint.h>
+#include <string>
+
+class siteRandom {
+
+ private:
+
+  uint64_t state;
+
+ public:
+
+  siteRandom(void);
+
+  void seed(uint64_t runSeed, const std::string & name, int64_t pos);
+
+  uint64_t next(void);
+
+  // uniform in [0, n)
+
+  uint32_t below(uint32_t n);
+};
+
+#endif
@@ -0,0 +1,227 @@
+//
+//  vcfWriter.cpp
+//  wham
+//
+
+#include "vcfWriter.h"
+
+#include <iostream>
+#include <unistd.h>
+
+using namespace std;
+
+vcfWriter::vcfWriter(vector<regionTask> & tasks, int nThreads, long int bytes){
+
+  head         = NULL;
+  pendingBytes = 0;
+  frontThread  = -1;
+  nLeft        = 0;
+  closed       = false;
+  window       = bytes;
+
+  current.resize(nThreads + 1, pieceKey(-1, 0));
+
+  for(vector<regionTask>::iterator it = tasks.begin(); it != tasks.end(); it++){
+    ordinalStart.push_back((*it).start);
+    ordinalEnd.push_back((*it).end);
+  }
+
+  frontOrdinal = 0;
+  frontStart   = ordinalStart.empty() ? 0 : ordinalStart.front();
+}
+
+vcfWriter::~vcfWriter(){
+  block * b = head.exchange(NULL);
+  while(b != NULL){
+    block * n = b->next;
+    delete b;
+    b = n;
+  }
+}
+
+void vcfWriter::push(block * b){
+  b->next = head.load();
+  while(! head.compare_exchange_weak(b->next, b)){
+  }
+}
+
+void vcfWriter::begin(int t, regionTask & task){
+
+  current[t] = pieceKey(task.ordinal, task.start);
+
+  block * b   = new block;
+  b->kind     = BLOCK_BEGIN;
+  b->thread   = t;
+  b->ordinal  = task.ordinal;
+  b->start    = task.start;
+  b->end      = task.end;
+  push(b);
+}
+
+// a thread ahead of the front waits while too much is held, as long as
+// the front is being run; the thread running it never waits
+
+void vcfWriter::add(int t, string & text){
+
+  if(text.empty()){
+    return;
+  }
+
+  while(pendingBytes.load() > window){
+    int front = frontThread.load();
+    if(front == -1 || front == t){
+      break;
+    }
+    usleep(2000);
+  }
+
+  pendingBytes += text.size();
+
+  block * b   = new block;
+  b->kind     = BLOCK_TEXT;
+  b->thread   = t;
+  b->ordinal  = current[t].first;
+  b->start    = current[t].second;
+  b->end      = 0;
+  b->text.swap(text);
+  push(b);
+}
+
+void vcfWriter::end(int t, regionTask & task){
+
+  block * b   = new block;
+  b->kind     = BLOCK_END;
+  b->thread   = t;
+  b->ordinal  = task.ordinal;
+  b->start    = task.start;
+  b->end      = task.end;
+  push(b);
+
+  current[t] = pieceKey(-1, 0);
+}
+
+void vcfWriter::leave(int nThreads){
+  if(++nLeft == nThreads){
+    closed = true;
+  }
+}
+
+void vcfWriter::write(piece & p){
+  for(vector<string>::iterator it = p.text.begin(); it != p.text.end(); it++){
+    cout << (*it);
+    pendingBytes -= (*it).size();
+  }
+  p.text.clear();
+}
+
+// writes the piece at the front and moves past every finished one
+
+void vcfWriter::advance(void){
+
+  while(frontOrdinal < (int) ordinalStart.size()){
+
+    map<pieceKey, piece>::iterator it
+      = pending.find(pieceKey(frontOrdinal, frontStart));
+
+    if(it == pending.end()){
+      frontThread = -1;
+      return;
+    }
+
+    write(it->second);
+
+    if(! it->second.finished){
+      frontThread = it->second.thread;
+      return;
+    }
+
+    frontStart = it->second.end;
+    pending.erase(it);
+
+    if(frontStart >= ordinalEnd[frontOrdinal]){
+      frontOrdinal += 1;
+      if(frontOrdinal < (int) ordinalStart.size()){
+	frontStart = ordinalStart[frontOrdinal];
+      }
+    }
+  }
+  frontThread = -1;
+}
+
+// takes everything handed over so far; the stack comes off newest
+// first, so it is turned around to keep each thread's text in order
+
+bool vcfWriter::drain(void){
+
+  block * b = head.exchange(NULL);
+
+  if(b == NULL){
+    return false;
+  }
+
+  block * ordered = NULL;
+  while(b != NULL){
+    block * n = b->next;
+    b->next   = ordered;
+    ordered   = b;
+    b         = n;
+  }
+
+  while(ordered != NULL){
+
+    block * n = ordered->next;
+
+    piece & p = pending[pieceKey(ordered->ordinal, ordered->start)];
+
+    switch(ordered->kind){
+    case BLOCK_BEGIN:
+      p.finished = false;
+      p.end      = ordered->end;
+      p.thread   = ordered->thread;
+      break;
+    case BLOCK_TEXT:
+      p.text.push_back(string());
+      p.text.back().swap(ordered->text);
+      break;
+    case BLOCK_END:
+      p.finished = true;
+      p.end      = ordered->end;
+      break;
+    }
+    delete ordered;
+    ordered = n;
+  }
+
+  advance();
+
+  return true;
+}
+
+void vcfWriter::run(void){
+
+  while(true){
+
+    bool last = closed.load();
+
+    if(! drain()){
+      if(last){
+	break;
+      }
+      usleep(2000);
+    }
+  }
+
+  // nothing should be left; if the pieces did not tile the regions the
+  // rest still goes out, in order
+
+  if(! pending.empty()){
+    cerr << "WARNING: " << pending.size()
+	 << " region outputs were written out of order" << endl;
+    for(map<pieceKey, piece>::iterator it = pending.begin();
+	it != pending.end(); it++){
+      write(it->second);
+    }
+    pending.clear();
+  }
+  cout.flush();
+}
@@ -0,0 +1,99 @@
+//
+//  vcfWriter.h
+//  wham
+//
+//  Writes the VCF records of the region threads in genomic order.  The
+//  threads hand finished text over through a lock-free stack and one
+//  writer thread puts it back in order.  Regions are numbered in
+//  genomic order; a region split at run time hands on its number, and
+//  its pieces tile it, so the writer knows the next text to write is the
+//  piece that starts where the last one ended.
+//
+
+#ifndef vcfWriter_h
+#define vcfWriter_h
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "regionScheduler.h"
+
+class vcfWriter {
+
+ private:
+
+  enum blockKind { BLOCK_BEGIN, BLOCK_TEXT, BLOCK_END };
+
+  struct block{
+    block *    next   ;
+    blockKind  kind   ;
+    int        thread ;
+    int        ordinal;
+    long int   start  ;
+    long int   end    ;
+    std::string text  ;
+  };
+
+  struct piece{
+    std::vector<std::string> text    ;
+    bool                     finished;
+    long int                 end     ;
+    int                      thread  ;
+
+    piece(void) : finished(false), end(0), thread(-1) {}
+  };
+
+  typedef std::pair<int, long int> pieceKey;
+
+  // shared with the region threads
+
+  std::atomic<block *>  head        ;
+  std::atomic<long int> pendingBytes;  // handed over but not yet written
+  std::atomic<int>      frontThread ;  // running the next piece, or -1
+  std::atomic<int>      nLeft       ;  // region threads that are finished
+  std::atomic<bool>     closed      ;
+
+  long int window;
+
+  // the region each thread is running, touched only by that thread
+
+  std::vector<pieceKey> current;
+
+  // the writer's side
+
+  std::vector<long int>       ordinalStart;
+  std::vector<long int>       ordinalEnd  ;
+  std::map<pieceKey, piece>   pending     ;
+  int                         frontOrdinal;
+  long int                    frontStart  ;
+
+  void   push(block *);
+  bool   drain(void);
+  void   advance(void);
+  void   write(piece &);
+
+ public:
+
+  // the regions in genomic order (their ordinals are their indices),
+  // the number of region threads, and the bytes a thread may get ahead
+  // of the front before it waits
+
+  vcfWriter(std::vector<regionTask> &, int, long int);
+  ~vcfWriter();
+
+  // region threads
+
+  void begin(int, regionTask &);
+  void add(int, std::string &);
+  void end(int, regionTask &);
+  void leave(int);
+
+  // the writer thread; returns once every region thread has left.
+  // Called again after the run it writes whatever is left.
+
+  void run(void);
+};
+
+#endif
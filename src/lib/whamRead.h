@@ -0,0 +1,131 @@
+//
+//  whamRead.h
+//  wham
+//
+//  The compact read record the pileup and scorer work from.  Only the
+//  fields WHAM-BAM scores on are kept; the strings of decoded reads
+//  live in a per-region arena and are referenced by offset.
+//
+
+#ifndef whamRead_h
+#define whamRead_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct arenaString{
+  uint32_t offset;
+  uint32_t length;
+};
+
+class stringArena {
+
+ private:
+
+  std::vector<char> data;
+
+ public:
+
+  arenaString add(const std::string & s){
+    arenaString a;
+    a.offset = data.size();
+    a.length = s.size();
+    data.insert(data.end(), s.begin(), s.end());
+    return a;
+  }
+
+  arenaString add(const char * s, uint32_t length){
+    arenaString a;
+    a.offset = data.size();
+    a.length = length;
+    data.insert(data.end(), s, s + length);
+    return a;
+  }
+
+  const char * at(const arenaString & a) const {
+    return data.data() + a.offset;
+  }
+
+  std::string str(const arenaString & a) const {
+    if(a.length == 0){
+      return std::string();
+    }
+    return std::string(at(a), a.length);
+  }
+
+  size_t size(void) const {
+    return data.size();
+  }
+
+  void clear(void){
+    data.clear();
+  }
+
+  void swap(stringArena & other){
+    data.swap(other.data);
+  }
+};
+
+// one entry of an SA or XA tag, parsed when the read is loaded
+
+struct otherAlignment{
+  arenaString seqid      ;  // reference name, a slice of the stored tag
+  int32_t     pos        ;  // as written in the tag
+  int32_t     end        ;  // pos plus the M and I lengths
+  uint32_t    frontLength;  // first and last CIGAR operations; the
+  uint32_t    backLength ;  // types are 0 if the entry had no CIGAR
+  char        frontType  ;
+  char        backType   ;
+  char        strand     ;
+  uint8_t     mapQ       ;  // SA only
+  uint16_t    nm         ;
+};
+
+struct whamRead{
+
+  int32_t  position     ;  // leftmost aligned base, 0-based
+  int32_t  end          ;  // rightmost aligned base, GetEndPosition(false,true)
+  int32_t  refId        ;
+  int32_t  mateRefId    ;
+  int32_t  matePosition ;
+  int32_t  insertSize   ;
+  uint32_t flag         ;
+  uint32_t frontLength  ;  // first and last CIGAR operations
+  uint32_t backLength   ;
+  uint32_t readGroup    ;  // readGroupIndex number, over all samples
+  uint32_t length       ;  // query length
+  uint16_t mapQ         ;
+  uint16_t sample       ;  // index into the list of all bams
+  char     frontType    ;
+  char     backType     ;
+  uint8_t  nLongIns     ;  // internal insertions and deletions over 25bp
+  uint8_t  nLongDel     ;
+  uint32_t serial       ;  // order of arrival within the region
+  uint64_t nameHash     ;  // hashReadName of the name
+  uint32_t otherFirst   ;  // SA then XA entries in readPileUp::others
+  uint8_t  nSa          ;
+  uint8_t  nXa          ;
+
+  // empty for reads that were never decoded
+
+  arenaString name ;
+  arenaString bases;
+  arenaString quals;  // soft clipped reads only, for the clip consensus
+  arenaString sa   ;
+  arenaString xa   ;
+
+  bool isPaired(void)            const { return (flag & 0x0001) != 0; }
+  bool isProperPair(void)        const { return (flag & 0x0002) != 0; }
+  bool isMateMapped(void)        const { return (flag & 0x0008) == 0; }
+  bool isReverseStrand(void)     const { return (flag & 0x0010) != 0; }
+  bool isMateReverseStrand(void) const { return (flag & 0x0020) != 0; }
+  bool isPrimaryAlignment(void)  const { return (flag & 0x0100) == 0; }
+  bool isSupplementary(void)     const { return (flag & 0x0800) != 0; }
+
+  uint32_t stringBytes(void) const {
+    return name.length + bases.length + quals.length + sa.length + xa.length;
+  }
+};
+
+#endif
@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# --two-phase has to call what a full scan calls.  The data simulated
+# here has a deletion shared by six samples, none of which has the
+# clipped reads to call it alone, and a second one whose clipped reads
+# are mostly in a sample without split or discordant reads there (see
+# simulate.py); the full scan calls both from the reads together, and
+# so must --two-phase.
+#
+# usage: test/two-phase/run.sh <WHAM-BAM>
+#
+# needs samtools and python on the PATH (PYTHON overrides the latter)
+
+set -e
+
+if [ $# -ne 1 ] || [ ! -x "$1" ]; then
+    echo "usage: $0 <WHAM-BAM>" >&2
+    exit 1
+fi
+
+WHAM=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+HERE=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/wham-test.XXXXXX")
+
+trap 'rm -rf "$WORK"' EXIT
+
+${PYTHON:-python3} "$HERE/simulate.py" "$WORK"
+
+cd "$WORK"
+
+for sam in s*.sam; do
+    samtools view -bS "$sam" > "${sam%.sam}.bam" 2> /dev/null
+    samtools index "${sam%.sam}.bam"
+done
+
+run(){
+    "$WHAM" -x 2 -s 1 -t s0.bam,s1.bam,s2.bam -b s3.bam,s4.bam,s5.bam,s6.bam "$@" > calls.vcf 2> calls.err || {
+	cat calls.err >&2
+	exit 1
+    }
+    grep -v "^#" calls.vcf | sort -k1,1 -k2,2n
+}
+
+run                > full.txt
+run --two-phase    > two-phase.txt
+
+for site in 10150 15060; do
+    if ! grep -q "^chr1	${site}[01]	" full.txt; then
+	echo "FAIL: the full scan did not call the deletion ending at ${site}x" >&2
+	exit 1
+    fi
+done
+
+if ! cmp -s full.txt two-phase.txt; then
+    echo "FAIL: --two-phase differs from the full scan:" >&2
+    diff full.txt two-phase.txt >&2 || true
+    exit 1
+fi
+
+echo "PASS: --two-phase calls the $(wc -l < full.txt | tr -d ' ') record(s) of the full scan"
@@ -0,0 +1,120 @@
+#!/usr/bin/python
+#
+# Writes a small paired-end data set for the --two-phase test: one
+# reference and several samples that share a deletion.  Each sample has
+# only a few reads across the breakpoints, and at most two of them have
+# a clip long enough to count as a distinct clipped sequence.  No sample
+# alone has enough evidence for a call; the samples together do.
+#
+# A second deletion has one split read in each of two samples, and its
+# other clipped reads in a last sample whose clips are all too short
+# for an SA tag, so that sample has no split or discordant read there.
+# Only the clipped ends of all three bring it to a call.
+#
+# usage: simulate.py <out dir> [seed]
+#
+# Each sample is written as <out dir>/<sample>.sam, sorted by position;
+# the reference goes to <out dir>/ref.fa.
+
+import random, sys
+
+OUT = sys.argv[1]
+rng = random.Random(int(sys.argv[2]) if len(sys.argv) > 2 else 11)
+
+READ     = 100
+REF_LEN  = 200000
+DEPTH    = 8.0          # of the reference reads, per sample
+INSERT   = (350, 35)    # mean and sd
+SAMPLES  = 7
+DELETION = (100000, 101500)
+SECOND   = (150000, 150600)
+
+ref = "".join(rng.choice("ACGT") for _ in range(REF_LEN))
+
+# the bases each sample's breakpoint reads take from the other side of
+# the deletion: the reads at the right end are front clipped, the one
+# at the left end is back clipped.  Clips under 10 bp are not counted
+# as clipped sequences.
+
+def overhangs(s):
+    if s == SAMPLES - 1:
+        return [], []
+    front = [6, 25, 45] if s == 0 else [4, 8, 30 + 3 * s]
+    back  = [15 + 2 * s]
+    return front, back
+
+def secondOverhangs(s):
+    if s == SAMPLES - 1:
+        return [11, 13, 16]
+    return [28 + 7 * s] if s < 2 else []
+
+def pair(name, first, second, size):
+    """two SAM records; first is forward, second reverse.  Each is
+    (position, cigar, sequence, tags)."""
+    recs = []
+    for m, (read, mate) in enumerate([(first, second), (second, first)]):
+        flag = 1 | 2 | (0x40 if m == 0 else 0x80)
+        flag |= 0x10 if m == 1 else 0x20
+        tlen = size if m == 0 else -size
+        recs.append((read[0], [name, flag, "chr1", read[0] + 1, 60, read[1], "=",
+                               mate[0] + 1, tlen, read[2], "I" * READ] + read[3]))
+    return recs
+
+for s in range(SAMPLES):
+    name = "s%d" % s
+    rg   = ["RG:Z:" + name]
+    recs = []
+
+    for n in range(int(REF_LEN * DEPTH / (2 * READ))):
+        size  = max(2 * READ, int(rng.gauss(*INSERT)))
+        start = rng.randint(0, REF_LEN - size - 1)
+        end   = start + size - READ
+        recs += pair("%s_r%d" % (name, n),
+                     (start, "%dM" % READ, ref[start:start + READ], rg),
+                     (end,   "%dM" % READ, ref[end:end + READ],     rg), size)
+
+    front, back = overhangs(s)
+
+    def frontClipped(tag, deletion, k):
+        left = deletion[0] - k
+        seq  = ref[left:deletion[0]] + ref[deletion[1]:deletion[1] + READ - k]
+        tags = list(rg)
+        if k >= 20:
+            tags.append("SA:Z:chr1,%d,+,%dM%dS,60,0;" % (left + 1, k, READ - k))
+        mate = deletion[1] + 250
+        return pair("%s_%s" % (name, tag),
+                    (deletion[1], "%dS%dM" % (k, READ - k), seq, tags),
+                    (mate, "%dM" % READ, ref[mate:mate + READ], rg),
+                    mate + READ - deletion[1])
+
+    for n, k in enumerate(front):
+        recs += frontClipped("f%d" % n, DELETION, k)
+
+    for n, k in enumerate(secondOverhangs(s)):
+        recs += frontClipped("g%d" % n, SECOND, k)
+
+    for n, k in enumerate(back):
+        start = DELETION[0] - (READ - k)
+        seq   = ref[start:DELETION[0]] + ref[DELETION[1]:DELETION[1] + k]
+        tags  = list(rg)
+        if k >= 20:
+            tags.append("SA:Z:chr1,%d,-,%dS%dM,60,0;" % (DELETION[1] + 1, READ - k, k))
+        mate = start - 250
+        recs += pair("%s_b%d" % (name, n),
+                     (mate, "%dM" % READ, ref[mate:mate + READ], rg),
+                     (start, "%dM%dS" % (READ - k, k), seq, tags),
+                     DELETION[0] - mate)
+
+    recs.sort(key=lambda r: r[0])
+
+    with open("%s/%s.sam" % (OUT, name), "w") as f:
+        f.write("@HD\tVN:1.4\tSO:coordinate\n")
+        f.write("@SQ\tSN:chr1\tLN:%d\n" % REF_LEN)
+        f.write("@RG\tID:%s\tSM:%s\n" % (name, name))
+        for r in recs:
+            f.write("\t".join(str(x) for x in r[1]) + "\n")
+
+with open("%s/ref.fa" % OUT, "w") as f:
+    f.write(">chr1\n")
+    for i in range(0, REF_LEN, 60):
+        f.write(ref[i:i + 60] + "\n")